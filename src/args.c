@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+    Contains command-line parsing functions shared by the tools
+*/
+
+// Returns true if `arg` parsed completely as a number no less than `min` into `value`
+bool ParseNumberArg(const char *arg, double min, double *value) {
+    char *end;
+    double parsed = strtod(arg, &end);
+    if (end == arg || *end != '\0' || !(parsed >= min)) return false;
+    *value = parsed;
+    return true;
+}
+
+// Returns true if `arg` parsed completely as a whole number no less than `min` into `value`
+bool ParseSizeArg(const char *arg, size_t min, size_t *value) {
+    char *end;
+    if (arg[0] < '0' || arg[0] > '9') return false;
+    unsigned long long parsed = strtoull(arg, &end, 10);
+    if (*end != '\0' || parsed < min || parsed > (size_t)-1) return false;
+    *value = (size_t)parsed;
+    return true;
+}
+
+// Longest item of a list that can be parsed; a longer one fails, rather than being cut short into another number
+#define MAX_ITEM_LENGTH 63
+
+// Copies the item at `*arg`, up to the next `,` or `/` (or the end), into `item` and moves `*arg` onto that separator
+// Returns false if the item is longer than `MAX_ITEM_LENGTH`
+static bool NextItem(const char **arg, char item[MAX_ITEM_LENGTH + 1]) {
+    size_t length = strcspn(*arg, ",/");
+    if (length > MAX_ITEM_LENGTH) return false;
+    memcpy(item, *arg, length);
+    item[length] = '\0';
+    *arg += length;
+    return true;
+}
+
+// Parses the comma-separated whole numbers at `*arg` into `values`, stopping at a `/` or the end, which `*arg` is left on
+static bool ParseSizeItems(const char **arg, size_t min, size_t *values, size_t capacity, size_t *count) {
+    char item[MAX_ITEM_LENGTH + 1];
+    *count = 0;
+    do {
+        if (*count > 0) (*arg)++; // past the comma
+        if (*count == capacity || !NextItem(arg, item) || !ParseSizeArg(item, min, &values[*count])) return false;
+        (*count)++;
+    } while (**arg == ',');
+    return true;
+}
+
+// Returns true if `arg` parsed completely as a comma-separated list of 1 to `capacity` numbers no less than `min`
+bool ParseNumberList(const char *arg, double min, double *values, size_t capacity, size_t *count) {
+    char item[MAX_ITEM_LENGTH + 1];
+    *count = 0;
+    do {
+        if (*count > 0) arg++; // past the comma
+        if (*count == capacity || !NextItem(&arg, item) || !ParseNumberArg(item, min, &values[*count])) return false;
+        (*count)++;
+    } while (*arg == ',');
+    return *arg == '\0';
+}
+
+// Returns true if `arg` parsed completely as a comma-separated list of 1 to `capacity` whole numbers no less than `min`
+bool ParseSizeList(const char *arg, size_t min, size_t *values, size_t capacity, size_t *count) {
+    return ParseSizeItems(&arg, min, values, capacity, count) && *arg == '\0';
+}
+
+// Returns true if `arg` parsed completely as 1 to `list_capacity` `/`-separated lists of whole numbers no less than `min`,
+// like `64,10/128,10`, each of 1 to `capacity` numbers
+// List `i` is put in `values[i * capacity]` onwards, with its length in `counts[i]`
+bool ParseSizeLists(const char *arg, size_t min, size_t *values, size_t capacity, size_t *counts, size_t list_capacity, size_t *list_count) {
+    *list_count = 0;
+    do {
+        if (*list_count > 0) arg++; // past the slash
+        if (*list_count == list_capacity || !ParseSizeItems(&arg, min, &values[*list_count * capacity], capacity, &counts[*list_count])) return false;
+        (*list_count)++;
+    } while (*arg == '/');
+    return *arg == '\0';
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "main.h"
+#if defined(__AVX512BF16__) && defined(__AVX512DQ__)
+    #include <immintrin.h>
+#endif
+
+/*
+    Contains bfloat16 copies of the dense weights, and the kernels that run on them
+
+    bfloat16 is the top half of an IEEE single: the same exponent range, with 8 bits of mantissa. The kernels spend most of
+    their time streaming weights from memory, so storing them in 2 bytes rather than 8 cuts that traffic by 4 times
+    The weights are widened to fp32 in registers (which only takes a shift), and multiplied by fp32 copies of the inputs,
+    summing in fp32; neurons and jacobians stay fp64
+    Training keeps the fp64 weights as the master copy, as steps are far smaller than a bfloat16's precision: gradients are
+    found with the bfloat16 weights and applied to the fp64 ones, which are then rounded again
+
+    Rounding is to nearest even, with subnormals flushed to 0; with AVX-512 BF16 it's done by `vcvtneps2bf16`, which does
+    the same, so results don't depend on the instruction set
+*/
+
+static float Bf16ToFloat(uint16_t value) {
+    uint32_t bits = (uint32_t)value << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static uint16_t FloatToBf16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) return (uint16_t)((bits >> 16) | 0x0040u); // NaN, kept quiet
+    if ((bits & 0x7F800000u) == 0) return (uint16_t)((bits >> 16) & 0x8000u); // subnormal, flushed to a signed 0
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+// Rounds `count` doubles from `in` into bfloat16s in `out`
+void NarrowToBf16(size_t count, const double *in, uint16_t *out) {
+    size_t i = 0;
+#if defined(__AVX512BF16__) && defined(__AVX512DQ__)
+    for (; i + 16 <= count; i += 16) {
+        __m512 floats = _mm512_insertf32x8(_mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_loadu_pd(&in[i]))), _mm512_cvtpd_ps(_mm512_loadu_pd(&in[i + 8])), 1);
+        __m256bh narrowed = _mm512_cvtneps_pbh(floats);
+        memcpy(&out[i], &narrowed, sizeof(narrowed));
+    }
+#endif
+    for (; i < count; i++) out[i] = FloatToBf16((float)in[i]);
+}
+
+// Safe to call when `net->bf16_weights` is NULL
+void FreeBf16Weights(Network *net) {
+    free(net->all_bf16_weights);
+    free(net->bf16_weights);
+    net->all_bf16_weights = NULL;
+    net->bf16_weights = NULL;
+}
+
+// Returns 0 on success, 1 on failure
+// Builds `net->bf16_weights` from the current weights, used by `ForwardPassBatch()` and batched training instead of them
+// Scratches must be allocated afterwards, as they then hold fp32 copies of the inputs for the kernels
+int BuildBf16Weights(Network *net) {
+    FreeBf16Weights(net);
+    net->bf16_weights = malloc(net->layers_count * sizeof(uint16_t*));
+    net->all_bf16_weights = malloc(net->total_weight_count * sizeof(uint16_t));
+    if (net->bf16_weights == NULL || net->all_bf16_weights == NULL) {
+        FreeBf16Weights(net);
+        return 1;
+    }
+    for (size_t i = 0; i < net->layers_count; i++) net->bf16_weights[i] = &net->all_bf16_weights[net->weights[i] - net->all_weights];
+    UpdateBf16Weights(net);
+    return 0;
+}
+
+// Rounds every weight into `net->bf16_weights` again, after they've been changed other than by `TrainEpoch()`
+void UpdateBf16Weights(Network *net) {
+    NarrowToBf16(net->total_weight_count, net->all_weights, net->all_bf16_weights);
+}
+
+// `outmatrix = (matrix)(inmatrix)` for each of `batch` samples, with a bfloat16 `matrix` (see `TransformBatch()`)
+// `inmatrix` is first rounded into `narrowed` (`batch * width` long) as fp32; each output is summed in fp32
+void TransformBatchBf16(size_t width, size_t height, size_t batch, const uint16_t *matrix, const double *inmatrix, float *narrowed, double *outmatrix, size_t tile) {
+    if (tile == 0 || tile > width) tile = width;
+    for (size_t i = 0; i < batch * width; i++) narrowed[i] = (float)inmatrix[i];
+    size_t b = 0;
+    for (; b + 4 <= batch; b += 4) {
+        const float *in0 = &narrowed[(b + 0) * width];
+        const float *in1 = &narrowed[(b + 1) * width];
+        const float *in2 = &narrowed[(b + 2) * width];
+        const float *in3 = &narrowed[(b + 3) * width];
+        for (size_t start = 0; start < width; start += tile) {
+            size_t end = width - start > tile ? start + tile : width;
+            for (size_t i = 0; i < height; i++) {
+                // partial sums are carried through `outmatrix` exactly, as they're fp32 values
+                float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+                if (start > 0) {
+                    sum0 = (float)outmatrix[((b + 0) * height) + i];
+                    sum1 = (float)outmatrix[((b + 1) * height) + i];
+                    sum2 = (float)outmatrix[((b + 2) * height) + i];
+                    sum3 = (float)outmatrix[((b + 3) * height) + i];
+                }
+                const uint16_t *matrix_row = &matrix[i * width];
+                for (size_t j = start; j < end; j++) {
+                    float weight = Bf16ToFloat(matrix_row[j]);
+                    sum0 += weight * in0[j];
+                    sum1 += weight * in1[j];
+                    sum2 += weight * in2[j];
+                    sum3 += weight * in3[j];
+                }
+                outmatrix[((b + 0) * height) + i] = sum0;
+                outmatrix[((b + 1) * height) + i] = sum1;
+                outmatrix[((b + 2) * height) + i] = sum2;
+                outmatrix[((b + 3) * height) + i] = sum3;
+            }
+        }
+    }
+    for (; b < batch; b++) {
+        const float *in = &narrowed[b * width];
+        for (size_t i = 0; i < height; i++) {
+            const uint16_t *matrix_row = &matrix[i * width];
+            float sum = 0.0f;
+            for (size_t j = 0; j < width; j++) sum += Bf16ToFloat(matrix_row[j]) * in[j];
+            outmatrix[(b * height) + i] = sum;
+        }
+    }
+}
+
+// `outmatrix = (matrix)^T(inmatrix)` for each of `batch` samples, with a bfloat16 `matrix` (see `TransformBatchTransposed()`)
+// Each weight is widened, but the jacobians are summed in fp64, as they're added to one row at a time
+void TransformBatchTransposedBf16(size_t width, size_t height, size_t batch, const uint16_t *matrix, const double *inmatrix, double *outmatrix, size_t tile) {
+    if (tile == 0 || tile > height) tile = height;
+    for (size_t j = 0; j < batch * width; j++) outmatrix[j] = 0.0;
+    for (size_t start = 0; start < height; start += tile) {
+        size_t end = height - start > tile ? start + tile : height;
+        for (size_t b = 0; b < batch; b++) {
+            double *outvector = &outmatrix[b * width];
+            for (size_t i = start; i < end; i++) {
+                double scale = inmatrix[(b * height) + i];
+                const uint16_t *matrix_row = &matrix[i * width];
+                for (size_t j = 0; j < width; j++) {
+                    outvector[j] += (double)Bf16ToFloat(matrix_row[j]) * scale;
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -4,6 +4,7 @@
 
     #include <stdint.h>
     #include <stdbool.h>
+    #include "network.h" // contains `ConvLayer`
     #ifndef MAX_PATH // this is here in case the platform has a different max path that's already defined; that should be used instead
         #define MAX_PATH 260 /* including null terminator */
     #endif
@@ -15,12 +16,23 @@
         bool *learningRateMultiplier_set; // should be set to `false` before calling `GetConfig()`
         double *learningRateMultiplier;
         bool *layersCount_set; // should be set to `false` before calling `GetConfig()`
-        size_t *layersCount;
+        size_t *layersCount; // ends up counting only the dense layers
         size_t **layerLengths;
+        size_t *convLayersCount; // conv/pool layer lines are counted here instead; may be NULL to skip them
+        ConvLayer **convLayers; // shapes are left for `GetConvShapes()`
         char *training_images_filename;
         char *training_labels_filename;
         char *testing_images_filename;
         char *testing_labels_filename;
+        // optional; left untouched when absent or empty, rather than asked for during runtime
+        double *targetSparsity;
+        size_t *pruningEpochs;
+        size_t *batchSize;
+        size_t *checkpointInterval;
+        char *tuningCache; // `MAX_PATH` long; emptied if the line is empty
+        size_t *pipelineStages;
+        size_t *microBatches;
+        size_t *bf16Weights; // nonzero to store weights as bfloat16
     } GetConfigContext;
 
 
@@ -0,0 +1,229 @@
+#include "main.h"
+
+/*
+    Contains the convolution and pooling layers that can come before the dense layers
+
+    Convolutions are lowered to matrix products with im2col: every window of the input is copied out into a row of
+    `columns`, so that the convolution becomes `TransformBatch()` of the filters over those rows, one row per output position
+*/
+
+// Number of values in one sample of the layer's output
+size_t ConvOutputSize(const ConvLayer *layer) {
+    return layer->out_height * layer->out_width * layer->out_channels;
+}
+
+// Returns 0 on success, 1 if a layer is invalid or doesn't fit its input
+// Fills in the input and output shapes of each of `conv_layers`, given single-channel `input_rows * input_cols` images
+int GetConvShapes(size_t input_rows, size_t input_cols, size_t conv_count, ConvLayer *conv_layers) {
+    size_t channels = 1;
+    size_t height = input_rows;
+    size_t width = input_cols;
+    for (size_t i = 0; i < conv_count; i++) {
+        ConvLayer *layer = &conv_layers[i];
+        if (layer->type != CONV_LAYER && layer->type != MAX_POOL_LAYER && layer->type != AVG_POOL_LAYER) return 1;
+        if (layer->kernel == 0 || layer->stride == 0 || layer->kernel > height || layer->kernel > width) return 1;
+        if (layer->type == CONV_LAYER && layer->filters == 0) return 1;
+        layer->in_channels = channels;
+        layer->in_height = height;
+        layer->in_width = width;
+        layer->out_channels = layer->type == CONV_LAYER ? layer->filters : channels;
+        layer->out_height = ((height - layer->kernel) / layer->stride) + 1;
+        layer->out_width = ((width - layer->kernel) / layer->stride) + 1;
+        channels = layer->out_channels;
+        height = layer->out_height;
+        width = layer->out_width;
+    }
+    return 0;
+}
+
+// Copies every `kernel * kernel` window of `input` into its own row of `columns`
+//
+// NOTE: each row of a window is contiguous in the channels-last layout, so windows are copied a row at a time
+static void Im2Col(const ConvLayer *layer, const double *input, double *columns) {
+    size_t rowLength = layer->kernel * layer->in_channels;
+    size_t window = layer->kernel * rowLength;
+    for (size_t y = 0; y < layer->out_height; y++) {
+        for (size_t x = 0; x < layer->out_width; x++) {
+            double *column = &columns[((y * layer->out_width) + x) * window];
+            for (size_t ky = 0; ky < layer->kernel; ky++) {
+                const double *inputRow = &input[((((y * layer->stride) + ky) * layer->in_width) + (x * layer->stride)) * layer->in_channels];
+                memcpy(&column[ky * rowLength], inputRow, rowLength * sizeof(double));
+            }
+        }
+    }
+}
+
+// Inverse of `Im2Col()`: sums each row of `columns` back into its window of `input`, which is overwritten
+static void Col2Im(const ConvLayer *layer, double *columns, double *input) {
+    size_t rowLength = layer->kernel * layer->in_channels;
+    size_t window = layer->kernel * rowLength;
+    memset(input, 0, layer->in_height * layer->in_width * layer->in_channels * sizeof(double));
+    for (size_t y = 0; y < layer->out_height; y++) {
+        for (size_t x = 0; x < layer->out_width; x++) {
+            double *column = &columns[((y * layer->out_width) + x) * window];
+            for (size_t ky = 0; ky < layer->kernel; ky++) {
+                double *inputRow = &input[((((y * layer->stride) + ky) * layer->in_width) + (x * layer->stride)) * layer->in_channels];
+                AddVector(rowLength, inputRow, &column[ky * rowLength]);
+            }
+        }
+    }
+}
+
+static void PoolForward(const ConvLayer *layer, const double *input, double *output) {
+    size_t channels = layer->in_channels;
+    for (size_t y = 0; y < layer->out_height; y++) {
+        for (size_t x = 0; x < layer->out_width; x++) {
+            double *out = &output[((y * layer->out_width) + x) * channels];
+            for (size_t c = 0; c < channels; c++) out[c] = layer->type == MAX_POOL_LAYER ? -HUGE_VAL : 0.0;
+            for (size_t ky = 0; ky < layer->kernel; ky++) {
+                for (size_t kx = 0; kx < layer->kernel; kx++) {
+                    const double *in = &input[((((y * layer->stride) + ky) * layer->in_width) + (x * layer->stride) + kx) * channels];
+                    if (layer->type == MAX_POOL_LAYER) {
+                        for (size_t c = 0; c < channels; c++) out[c] = in[c] > out[c] ? in[c] : out[c];
+                    } else {
+                        for (size_t c = 0; c < channels; c++) out[c] += in[c];
+                    }
+                }
+            }
+            if (layer->type == AVG_POOL_LAYER) {
+                for (size_t c = 0; c < channels; c++) out[c] /= (double)(layer->kernel * layer->kernel);
+            }
+        }
+    }
+}
+
+// Populates `inputJacobian` from `outputJacobian`; max pooling passes each derivative to the (first) largest input of its window
+static void PoolBackward(const ConvLayer *layer, const double *input, const double *outputJacobian, double *inputJacobian) {
+    size_t channels = layer->in_channels;
+    double windowArea = (double)(layer->kernel * layer->kernel);
+    memset(inputJacobian, 0, layer->in_height * layer->in_width * channels * sizeof(double));
+    for (size_t y = 0; y < layer->out_height; y++) {
+        for (size_t x = 0; x < layer->out_width; x++) {
+            const double *outJacobian = &outputJacobian[((y * layer->out_width) + x) * channels];
+            size_t corner = ((y * layer->stride * layer->in_width) + (x * layer->stride)) * channels; // top left of the window
+            for (size_t c = 0; c < channels; c++) {
+                if (layer->type == AVG_POOL_LAYER) {
+                    for (size_t ky = 0; ky < layer->kernel; ky++) {
+                        for (size_t kx = 0; kx < layer->kernel; kx++) {
+                            inputJacobian[corner + (((ky * layer->in_width) + kx) * channels) + c] += outJacobian[c] / windowArea;
+                        }
+                    }
+                    continue;
+                }
+                size_t largest = corner + c;
+                for (size_t ky = 0; ky < layer->kernel; ky++) {
+                    for (size_t kx = 0; kx < layer->kernel; kx++) {
+                        size_t i = corner + (((ky * layer->in_width) + kx) * channels) + c;
+                        if (input[i] > input[largest]) largest = i;
+                    }
+                }
+                inputJacobian[largest] += outJacobian[c];
+            }
+        }
+    }
+}
+
+// Runs the conv/pool layers on `batch` samples at once
+// `inputs` holds one sample per row; the dense layers' input for sample `b` is then at `&scratch->conv_outputs[net->conv_count - 1][b * net->dense_input_size]`
+void ConvForwardBatch(const Network *net, size_t batch, double *inputs, NetworkScratch *scratch) {
+    double *prevLayer = inputs;
+    size_t prevSize = net->input_size;
+    for (size_t i = 0; i < net->conv_count; i++) {
+        const ConvLayer *layer = &net->conv_layers[i];
+        size_t size = ConvOutputSize(layer);
+        for (size_t b = 0; b < batch; b++) {
+            double *input = &prevLayer[b * prevSize];
+            double *output = &scratch->conv_outputs[i][b * size];
+            if (layer->type != CONV_LAYER) {
+                PoolForward(layer, input, output);
+                continue;
+            }
+            size_t positions = layer->out_height * layer->out_width;
+            size_t window = layer->kernel * layer->kernel * layer->in_channels;
+            Im2Col(layer, input, scratch->columns);
+            // each output position is a "sample" of the filters, which gives channels-last output directly
+            TransformBatch(window, layer->filters, positions, layer->weights, scratch->columns, output, scratch->tiles.forward);
+            for (size_t p = 0; p < positions; p++) AddVector(layer->filters, &output[p * layer->filters], layer->biases);
+            ActivateVector(size, output, output);
+        }
+        prevLayer = scratch->conv_outputs[i];
+        prevSize = size;
+    }
+}
+
+// Backpropagates through one convolution, adding the derivative of cost with respect to its weights and biases to `gradients`
+// (laid out like `layer->weights` then `layer->biases`)
+// `outputJacobian` is the derivative of cost with respect to the activated output, and is overwritten
+// `inputJacobian` may be NULL (for the first layer, where it isn't needed)
+static void ConvBackward(const ConvLayer *layer, const double *input, const double *output, double *outputJacobian, double *inputJacobian,
+    double *columns, double *columnJacobians, double *gradients) {
+    size_t positions = layer->out_height * layer->out_width;
+    size_t window = layer->kernel * layer->kernel * layer->in_channels;
+    size_t filters = layer->filters;
+    double *biasGradients = &gradients[filters * window];
+
+    // the ReLU derivative is found from the activated output, which is only 0 where the deactivated output was negative
+    for (size_t i = 0; i < positions * filters; i++) {
+        if (output[i] <= 0.0) outputJacobian[i] = 0.0;
+    }
+
+    if (inputJacobian != NULL) {
+        memset(columnJacobians, 0, positions * window * sizeof(double));
+        for (size_t p = 0; p < positions; p++) {
+            double *columnJacobian = &columnJacobians[p * window];
+            for (size_t f = 0; f < filters; f++) {
+                double jacobian = outputJacobian[(p * filters) + f];
+                if (jacobian == 0.0) continue;
+                const double *filter = &layer->weights[f * window];
+                for (size_t k = 0; k < window; k++) columnJacobian[k] += jacobian * filter[k];
+            }
+        }
+        Col2Im(layer, columnJacobians, inputJacobian);
+    }
+
+    // `columns` has since been overwritten by later layers
+    Im2Col(layer, input, columns);
+    for (size_t p = 0; p < positions; p++) {
+        double *column = &columns[p * window];
+        for (size_t f = 0; f < filters; f++) {
+            double jacobian = outputJacobian[(p * filters) + f];
+            if (jacobian == 0.0) continue;
+            double *filterGradient = &gradients[f * window];
+            for (size_t k = 0; k < window; k++) filterGradient[k] += jacobian * column[k];
+            biasGradients[f] += jacobian;
+        }
+    }
+}
+
+// Backpropagates through the conv/pool layers of one sample, adding the derivative of cost with respect to the convolutions'
+// parameters to `scratch->conv_gradients`; `DescendConvLayers()` then steps them, so every sample of a batch sees the same filters
+// Call before the first dense layer's weights are updated
+// `input` is the sample's input layer, and `scratch->forward` must hold the forward pass of its batch, where it is number `sample`
+// `denseJacobian` is the derivative of cost with respect to the sample's deactivated first dense layer
+void BackPropagateConvLayers(const Network *net, TrainingScratch *scratch, size_t sample, double *input, double *denseJacobian) {
+    // derivative of cost with respect to the dense layers' input; the buffers then alternate so a layer's input and output derivatives never share one
+    double *outputJacobian = scratch->conv_jacobians[net->conv_count % 2];
+    TransformVectorTransposed(net->dense_input_size, net->layer_lengths[0], net->weights[0], denseJacobian, outputJacobian);
+    for (size_t i = net->conv_count; i-- > 0;) {
+        const ConvLayer *layer = &net->conv_layers[i];
+        double *layerInput = i == 0 ? input : &scratch->forward.conv_outputs[i - 1][sample * ConvOutputSize(&net->conv_layers[i - 1])];
+        double *layerOutput = &scratch->forward.conv_outputs[i][sample * ConvOutputSize(layer)];
+        double *inputJacobian = i == 0 ? NULL : scratch->conv_jacobians[i % 2];
+        if (layer->type == CONV_LAYER) {
+            double *gradients = &scratch->conv_gradients[layer->weights - net->all_conv_params];
+            ConvBackward(layer, layerInput, layerOutput, outputJacobian, inputJacobian, scratch->forward.columns, scratch->column_jacobians, gradients);
+        } else if (inputJacobian != NULL) {
+            PoolBackward(layer, layerInput, outputJacobian, inputJacobian);
+        }
+        outputJacobian = inputJacobian;
+    }
+}
+
+// Performs gradient descent on the convolutions with the gradients summed by `BackPropagateConvLayers()`, then clears them
+// `stepSize` is the learning rate divided by the number of samples summed
+void DescendConvLayers(Network *net, TrainingScratch *scratch, double stepSize) {
+    for (size_t i = 0; i < net->total_conv_param_count; i++) {
+        net->all_conv_params[i] -= stepSize * scratch->conv_gradients[i];
+        scratch->conv_gradients[i] = 0.0;
+    }
+}
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include <stdint.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <string.h>
 #include "config_context.h" // contains `MAX_PATH`
+#include "network.h"
 
 /*
     Contains file handling functions
@@ -37,31 +39,40 @@ typedef struct IDX_Labels_Header {
 } IDX_Labels_Header;
 #pragma pack(pop)
 
+// Opens an IDX3 image file for streaming, positioned at the first image; returns NULL on failure
+// Each image is then `row_count * col_count` bytes; close with `fclose()`
+FILE *OpenImages(const char *filename, uint32_t *image_count, uint32_t *row_count, uint32_t *col_count) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return NULL;
+    IDX_Images_Header header;
+    if (fread(&header, sizeof(header), 1, f) != 1) { (void)fclose(f); return NULL; }
+    if (header.magic != CorrectEndiannessFromBig(0x00000803)) { (void)fclose(f); return NULL; };
+    if (image_count != NULL) *image_count = CorrectEndiannessFromBig(header.image_count);
+    if (row_count != NULL) *row_count = CorrectEndiannessFromBig(header.row_count);
+    if (col_count != NULL) *col_count = CorrectEndiannessFromBig(header.col_count);
+    return f;
+}
+
 // Where `char **results = GetImages();`, only free `results[0]` and `results`, if and only if function returns non-NULL
 // Result is an array of images
 //
 // NOTE: consider using `restrict` on arguments
 char **GetImages(const char *filename, uint32_t *image_count, uint32_t *row_count, uint32_t *col_count) {
-    FILE *f = fopen(filename, "rb");
+    uint32_t count, rows, cols;
+    FILE *f = OpenImages(filename, &count, &rows, &cols);
     if (f == NULL) return NULL;
-    IDX_Images_Header header;
-    if (fread(&header, sizeof(header), 1, f) != 1) { (void)fclose(f); return NULL; }
-    if (header.magic != CorrectEndiannessFromBig(0x00000803)) { (void)fclose(f); return NULL; };
-    header.image_count = CorrectEndiannessFromBig(header.image_count);
-    header.row_count = CorrectEndiannessFromBig(header.row_count);
-    header.col_count = CorrectEndiannessFromBig(header.col_count);
-    char **data = malloc(header.image_count * sizeof(char*));
+    char **data = malloc(count * sizeof(char*));
     if (data == NULL) { (void)fclose(f); return NULL; }
-    size_t readbytes = header.image_count * header.row_count * header.col_count;
+    size_t readbytes = (size_t)count * rows * cols;
     char *rawdata = malloc(readbytes);
     if (rawdata == NULL) { free(data); (void)fclose(f); return NULL; };
     //(void)setvbuf(f, NULL, _IONBF, 0); // Turn off `fread()` buffering for performance; failure is acceptable
     if (fread(rawdata, sizeof(char), readbytes, f) != readbytes) { free(rawdata); free(data); (void)fclose(f); return NULL; }
     (void)fclose(f);
-    for (size_t i = 0; i < header.image_count; i++) data[i] = rawdata + (i * (header.row_count * header.col_count));
-    if (image_count != NULL) *image_count = header.image_count;
-    if (row_count != NULL) *row_count = header.row_count;
-    if (col_count != NULL) *col_count = header.col_count;
+    for (size_t i = 0; i < count; i++) data[i] = rawdata + (i * ((size_t)rows * cols));
+    if (image_count != NULL) *image_count = count;
+    if (row_count != NULL) *row_count = rows;
+    if (col_count != NULL) *col_count = cols;
     return data;
 }
 
@@ -89,6 +100,87 @@ char *GetLabels(const char *filename, uint32_t *label_count) {
 // returns a double to the power of a long
 extern double lpow(double a, long b);
 
+// Reads a line holding a decimal number into `*value`, leaving it untouched if the line is empty
+// Returns the character that ended the line (`'\n'` or `EOF`)
+static int ReadConfigDouble(FILE *configfile, double *value) {
+    int c;
+    long index = 0;
+    bool set = false;
+    double result = 0.0;
+    while ((c = fgetc(configfile)) != EOF && c != '\n') {
+        if (c == '.') {
+            index = 1;
+        } else if (c >= '0' && c <= '9') {
+            set = true;
+            if (index) {
+                result += (double)(c - '0') * lpow(10, -index);
+                index++;
+            } else {
+                result *= 10.0;
+                result += (double)(c - '0');
+            }
+        }
+    }
+    if (set && value != NULL) *value = result;
+    return c;
+}
+
+// Reads a line holding a whole number into `*value`, leaving it untouched if the line is empty
+// Returns the character that ended the line (`'\n'` or `EOF`)
+static int ReadConfigSize(FILE *configfile, size_t *value) {
+    int c;
+    bool set = false;
+    size_t result = 0;
+    while ((c = fgetc(configfile)) != EOF && c != '\n') {
+        if (c >= '0' && c <= '9') {
+            if ((SIZE_MAX - (c - '0')) / 10 < result) continue;
+            set = true;
+            result *= 10;
+            result += c - '0';
+        }
+    }
+    if (set && value != NULL) *value = result;
+    return c;
+}
+
+// Reads a line into `line`, truncating it to fit
+// Returns the character that ended the line (`'\n'` or `EOF`)
+static int ReadConfigLine(FILE *configfile, char *line, size_t size) {
+    int c;
+    size_t length = 0;
+    while ((c = fgetc(configfile)) != EOF && c != '\n') {
+        if (length < size - 1) line[length++] = (char)c;
+    }
+    line[length] = '\0';
+    return c;
+}
+
+// Returns 1 if `line` declares a conv/pool layer, parsing it into `layer`; 0 if it doesn't (so is a dense layer length); -1 if it's invalid
+// Conv/pool layers are `conv FILTERS KERNEL [STRIDE]`, `maxpool KERNEL [STRIDE]` or `avgpool KERNEL [STRIDE]`
+// Convolutions default to a stride of 1, and pools to a stride of their kernel (so windows don't overlap)
+static int ParseConvLayer(const char *line, ConvLayer *layer) {
+    char name[16];
+    size_t values[3] = { 0 };
+    memset(layer, 0, sizeof(*layer));
+    int fields = sscanf(line, " %15[a-z] %zu %zu %zu", name, &values[0], &values[1], &values[2]);
+    if (fields < 1) return 0;
+    if (strcmp(name, "conv") == 0) {
+        if (fields < 3) return -1;
+        layer->type = CONV_LAYER;
+        layer->filters = values[0];
+        layer->kernel = values[1];
+        layer->stride = fields > 3 ? values[2] : 1;
+    } else if (strcmp(name, "maxpool") == 0 || strcmp(name, "avgpool") == 0) {
+        if (fields < 2) return -1;
+        layer->type = name[0] == 'm' ? MAX_POOL_LAYER : AVG_POOL_LAYER;
+        layer->kernel = values[0];
+        layer->stride = fields > 2 ? values[1] : values[0];
+    } else {
+        return -1;
+    }
+    return layer->kernel > 0 && layer->stride > 0 && (layer->type != CONV_LAYER || layer->filters > 0) ? 1 : -1;
+}
+
 // Returns 0 on success, 1 on failure
 // Only fails if something has gone catastrophically wrong (e.g. malloc failure or irreparably invalidly formatted config file)
 //
@@ -146,30 +238,46 @@ int GetConfig(const char *config_filename, GetConfigContext *context) {
         }
     }
     if (c == EOF && *context->layersCount <= 0) return 0;
-    // layerLengths
+    // layerLengths, with any conv/pool layers (which must come first) moved into convLayers
     if (*context->layersCount) {
         *context->layerLengths = calloc((*context->layersCount), sizeof(size_t));
         if ((*context->layerLengths) == NULL) {
             return 1;
         }
+        size_t denseCount = 0;
         for (size_t i = 0; i < *context->layersCount; i++) {
-            // layerLengths[i]
-            while ((c = fgetc(configfile)) != EOF && c != '\n') {
-                if (c >= '0' && c <= '9') {
-                    if ((SIZE_MAX - (c - '0')) / 10 < (*context->layerLengths)[i]) continue;
-                    (*context->layerLengths)[i] *= 10;
-                    (*context->layerLengths)[i] += c - '0';
+            char line[64];
+            ConvLayer convLayer;
+            c = ReadConfigLine(configfile, line, sizeof(line));
+            int isConv = ParseConvLayer(line, &convLayer);
+            if (isConv < 0 || (isConv && denseCount > 0)) return 1; // irreparably invalid formatting
+            if (isConv && context->convLayersCount != NULL) {
+                ConvLayer *convLayers = realloc(*context->convLayers, (*context->convLayersCount + 1) * sizeof(ConvLayer));
+                if (convLayers == NULL) return 1;
+                convLayers[(*context->convLayersCount)++] = convLayer;
+                *context->convLayers = convLayers;
+            } else if (!isConv) {
+                // layerLengths[denseCount]
+                for (char *digit = line; *digit != '\0'; digit++) {
+                    if (*digit >= '0' && *digit <= '9') {
+                        if ((SIZE_MAX - (*digit - '0')) / 10 < (*context->layerLengths)[denseCount]) continue;
+                        (*context->layerLengths)[denseCount] *= 10;
+                        (*context->layerLengths)[denseCount] += *digit - '0';
+                    }
                 }
+                denseCount++;
             }
             if (c == EOF && i < *context->layersCount - 1) return 1; // irreparably invalid formatting
         }
+        if (denseCount == 0) return 1; // the output layer must be dense
+        *context->layersCount = denseCount;
     }
     if (c == EOF) return 0;
     // `fields` is the variable to be filled by the contents of the nth line
     char *fields[4] = { context->training_images_filename, context->training_labels_filename, context->testing_images_filename, context->testing_labels_filename };
     index = 0;
     size_t currField = 0;
-    while ((c = fgetc(configfile)) != EOF && currField < sizeof(fields) / sizeof(fields[0])) {
+    while (currField < sizeof(fields) / sizeof(fields[0]) && (c = fgetc(configfile)) != EOF) {
         if (c == '\n') {
             fields[currField][index] = '\0';
             currField++;
@@ -181,8 +289,318 @@ int GetConfig(const char *config_filename, GetConfigContext *context) {
             index++;
         }
     }
-    fields[currField][index] = '\0';
+    if (currField < sizeof(fields) / sizeof(fields[0])) fields[currField][index] = '\0';
+    // optional items
+    if (c != EOF) c = ReadConfigDouble(configfile, context->targetSparsity);
+    if (c != EOF) c = ReadConfigSize(configfile, context->pruningEpochs);
+    if (c != EOF) c = ReadConfigSize(configfile, context->batchSize);
+    if (c != EOF) c = ReadConfigSize(configfile, context->checkpointInterval);
+    if (c != EOF) {
+        char skipped[MAX_PATH];
+        c = ReadConfigLine(configfile, context->tuningCache != NULL ? context->tuningCache : skipped, MAX_PATH);
+    }
+    if (c != EOF) c = ReadConfigSize(configfile, context->pipelineStages);
+    if (c != EOF) c = ReadConfigSize(configfile, context->microBatches);
+    if (c != EOF) c = ReadConfigSize(configfile, context->bf16Weights);
     fclose(configfile);
 
     return 0;
+}
+
+// Returns 0 on success, 1 on failure
+// Reads the dataset filenames (each `MAX_PATH` long) from `config_filename` for the tools that share `cnn`'s config file, and
+// its learning rate into `learningRate` unless that's already positive (e.g. given on the command line)
+// `context` may be NULL, or point to any other fields to read like `GetConfig()`, such as the layers, which the caller frees
+int GetDatasetConfig(const char *config_filename, char *training_images_filename, char *training_labels_filename,
+    char *testing_images_filename, char *testing_labels_filename, double *learningRate, GetConfigContext *context) {
+    bool configLearningRate_set = false;
+    double configLearningRate = 0.0;
+    bool learningRateMultiplier_set = false;
+    double learningRateMultiplier = 0.0;
+    bool layersCount_set = false;
+    size_t layersCount = 0;
+    size_t *layerLengths = NULL;
+    GetConfigContext configContext = { 0 };
+    if (context != NULL) configContext = *context;
+    configContext.learningRate_set = &configLearningRate_set;
+    configContext.learningRate = &configLearningRate;
+    if (configContext.learningRateMultiplier_set == NULL) {
+        configContext.learningRateMultiplier_set = &learningRateMultiplier_set;
+        configContext.learningRateMultiplier = &learningRateMultiplier;
+    }
+    if (configContext.layersCount_set == NULL) {
+        configContext.layersCount_set = &layersCount_set;
+        configContext.layersCount = &layersCount;
+        configContext.layerLengths = &layerLengths;
+    }
+    configContext.training_images_filename = training_images_filename;
+    configContext.training_labels_filename = training_labels_filename;
+    configContext.testing_images_filename = testing_images_filename;
+    configContext.testing_labels_filename = testing_labels_filename;
+    int returnValue = GetConfig(config_filename, &configContext);
+    free(layerLengths);
+    if (*learningRate <= 0.0) *learningRate = configLearningRate;
+    return returnValue;
+}
+
+// from `network.c`
+// Returns 0 on success, 1 on failure
+extern int AllocConvNetwork(Network *net, size_t input_rows, size_t input_cols, size_t conv_count, const ConvLayer *conv_layers,
+    size_t layers_count, const size_t *layer_lengths);
+extern void FreeNetwork(Network *net);
+
+// from `sparse.c`
+// Returns 0 on success, 1 on failure
+extern int BuildSparseWeights(Network *net);
+
+// from `bf16.c`
+extern void NarrowToBf16(size_t count, const double *in, uint16_t *out);
+// Returns 0 on success, 1 on failure
+extern int BuildBf16Weights(Network *net);
+
+// First field of a `.nn` file; also detects files saved with a different endianness, which read as neither value
+#define NN_FORMAT_DENSE 1
+#define NN_FORMAT_SPARSE 2
+#define NN_FORMAT_BF16 3
+#define NN_FORMAT_CONV 0x10 // or-ed into the format of networks with conv/pool layers
+
+// Fields saved per conv/pool layer; the rest of `ConvLayer` is derived from these and the image shape
+#define CONV_LAYER_FIELDS 4
+
+// Weights rounded to bfloat16 at a time while saving
+#define BF16_CHUNK 4096
+
+// Returns 0 on success, 1 on failure
+// Format (all in native endianness):
+//     uint16_t format (`NN_FORMAT_DENSE`, `NN_FORMAT_SPARSE` or `NN_FORMAT_BF16`, or-ed with `NN_FORMAT_CONV` if there are conv/pool layers)
+//     uint64_t input size
+//     only with `NN_FORMAT_CONV`:
+//         uint64_t input rows, uint64_t input cols, uint64_t conv/pool layers count
+//         per conv/pool layer: uint64_t type, uint64_t kernel, uint64_t stride, uint64_t filters
+//     uint64_t layers count
+//     uint64_t layer lengths[layers count]
+//     uint64_t sizeof(double)
+//     only with `NN_FORMAT_CONV`: double conv params[total conv param count] (per convolution, its weights then its biases)
+//     weights, either
+//         dense: double weights[total weight count]
+//         bfloat16: uint16_t weights[total weight count], each the top half of an IEEE single
+//         sparse, per layer, in CSR form: uint64_t nnz, uint64_t row starts[layer length + 1], uint32_t column indices[nnz], double values[nnz]
+//     double biases[total neuron count]
+static int WriteNetwork(const char *filename, const Network *net, uint16_t format) {
+    FILE *savefile = fopen(filename, "wb");
+    if (savefile == NULL) return 1;
+    uint64_t double_size = (uint64_t)sizeof(double); // the furthest i was willing to go to conform to the C standard
+    uint64_t inputSize = (uint64_t)net->input_size;
+    uint64_t layers_count_64 = (uint64_t)net->layers_count;
+    uint64_t *layer_lengths_64 = malloc(net->layers_count * sizeof(uint64_t));
+    if (layer_lengths_64 == NULL) { (void)fclose(savefile); return 1; }
+    for (size_t i = 0; i < net->layers_count; i++) layer_lengths_64[i] = (uint64_t)net->layer_lengths[i];
+    if (net->conv_count > 0) format |= NN_FORMAT_CONV;
+    if (fwrite(&format, sizeof(uint16_t), 1, savefile) != 1) goto fWriteError;
+    if (fwrite(&inputSize, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
+    if (net->conv_count > 0) {
+        uint64_t convHeader[3] = { (uint64_t)net->conv_layers[0].in_height, (uint64_t)net->conv_layers[0].in_width, (uint64_t)net->conv_count };
+        if (fwrite(convHeader, sizeof(uint64_t), 3, savefile) != 3) goto fWriteError;
+        for (size_t i = 0; i < net->conv_count; i++) {
+            const ConvLayer *layer = &net->conv_layers[i];
+            uint64_t fields[CONV_LAYER_FIELDS] = { (uint64_t)layer->type, (uint64_t)layer->kernel, (uint64_t)layer->stride, (uint64_t)layer->filters };
+            if (fwrite(fields, sizeof(uint64_t), CONV_LAYER_FIELDS, savefile) != CONV_LAYER_FIELDS) goto fWriteError;
+        }
+    }
+    if (fwrite(&layers_count_64, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
+    if (fwrite(layer_lengths_64, sizeof(uint64_t), net->layers_count, savefile) != net->layers_count) goto fWriteError;
+    if (fwrite(&double_size, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError; // records `sizeof(double)` for correct interpretation during loading
+    if (net->total_conv_param_count > 0 && fwrite(net->all_conv_params, sizeof(double), net->total_conv_param_count, savefile) != net->total_conv_param_count) goto fWriteError;
+    if ((format & ~NN_FORMAT_CONV) == NN_FORMAT_DENSE) {
+        if (fwrite(net->all_weights, sizeof(double), net->total_weight_count, savefile) != net->total_weight_count) goto fWriteError;
+    } else if ((format & ~NN_FORMAT_CONV) == NN_FORMAT_BF16) {
+        uint16_t chunk[BF16_CHUNK];
+        for (size_t i = 0; i < net->total_weight_count; i += BF16_CHUNK) {
+            size_t count = net->total_weight_count - i < BF16_CHUNK ? net->total_weight_count - i : BF16_CHUNK;
+            NarrowToBf16(count, &net->all_weights[i], chunk);
+            if (fwrite(chunk, sizeof(uint16_t), count, savefile) != count) goto fWriteError;
+        }
+    } else {
+        size_t prevLength = net->dense_input_size;
+        for (size_t layer = 0; layer < net->layers_count; layer++) {
+            size_t rows = net->layer_lengths[layer];
+            size_t cols = prevLength;
+            double *weights = net->weights[layer];
+            uint64_t nnz = 0;
+            for (size_t i = 0; i < rows * cols; i++) nnz += weights[i] != 0.0;
+            if (fwrite(&nnz, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
+            uint64_t rowStart = 0;
+            for (size_t row = 0; row < rows; row++) {
+                if (fwrite(&rowStart, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
+                for (size_t col = 0; col < cols; col++) rowStart += weights[(row * cols) + col] != 0.0;
+            }
+            if (fwrite(&rowStart, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
+            for (size_t i = 0; i < rows * cols; i++) {
+                uint32_t col = (uint32_t)(i % cols);
+                if (weights[i] != 0.0 && fwrite(&col, sizeof(uint32_t), 1, savefile) != 1) goto fWriteError;
+            }
+            for (size_t i = 0; i < rows * cols; i++) {
+                if (weights[i] != 0.0 && fwrite(&weights[i], sizeof(double), 1, savefile) != 1) goto fWriteError;
+            }
+            prevLength = rows;
+        }
+    }
+    if (fwrite(net->all_biases, sizeof(double), net->total_neuron_count, savefile) != net->total_neuron_count) goto fWriteError;
+    free(layer_lengths_64);
+    return fclose(savefile) != 0;
+    fWriteError:
+    free(layer_lengths_64);
+    (void)fclose(savefile);
+    return 1;
+}
+
+// Returns 0 on success, 1 on failure
+// Writes `net` in the dense `.nn` format
+int SaveNetwork(const char *filename, const Network *net) {
+    return WriteNetwork(filename, net, NN_FORMAT_DENSE);
+}
+
+// Returns 0 on success, 1 on failure
+// Writes `net` in the sparse `.nn` format, storing only nonzero weights
+int SaveSparseNetwork(const char *filename, const Network *net) {
+    if (net->dense_input_size > UINT32_MAX) return 1;
+    for (size_t i = 0; i + 1 < net->layers_count; i++) {
+        if (net->layer_lengths[i] > UINT32_MAX) return 1;
+    }
+    return WriteNetwork(filename, net, NN_FORMAT_SPARSE);
+}
+
+// Returns 0 on success, 1 on failure
+// Writes `net` in the bfloat16 `.nn` format, storing each weight rounded to bfloat16 (a quarter of the size of `SaveNetwork()`'s)
+int SaveBf16Network(const char *filename, const Network *net) {
+    return WriteNetwork(filename, net, NN_FORMAT_BF16);
+}
+
+// Returns the size in bytes of `net` saved by `SaveSparseNetwork()` if `sparse`, otherwise by `SaveNetwork()`
+size_t GetNetworkFileSize(const Network *net, bool sparse) {
+    size_t size = sizeof(uint16_t) + (3 + net->layers_count) * sizeof(uint64_t) + net->total_neuron_count * sizeof(double);
+    if (net->conv_count > 0) size += (3 + (net->conv_count * CONV_LAYER_FIELDS)) * sizeof(uint64_t) + net->total_conv_param_count * sizeof(double);
+    if (!sparse) return size + net->total_weight_count * sizeof(double);
+    for (size_t layer = 0; layer < net->layers_count; layer++) size += (net->layer_lengths[layer] + 2) * sizeof(uint64_t);
+    for (size_t i = 0; i < net->total_weight_count; i++) {
+        if (net->all_weights[i] != 0.0) size += sizeof(uint32_t) + sizeof(double);
+    }
+    return size;
+}
+
+// Reads the sparse weights section of a `.nn` file into `net->weights`; returns 0 on success, 1 on failure
+static int ReadSparseWeights(FILE *f, Network *net) {
+    memset(net->all_weights, 0, net->total_weight_count * sizeof(double));
+    size_t prevLength = net->dense_input_size;
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        size_t rows = net->layer_lengths[layer];
+        size_t cols = prevLength;
+        prevLength = rows;
+        uint64_t nnz;
+        if (fread(&nnz, sizeof(uint64_t), 1, f) != 1 || nnz > rows * cols) return 1;
+        uint64_t *rowStarts = malloc((rows + 1) * sizeof(uint64_t));
+        uint32_t *colIndices = malloc(((size_t)nnz + 1) * sizeof(uint32_t));
+        double *values = malloc(((size_t)nnz + 1) * sizeof(double));
+        int failed = rowStarts == NULL || colIndices == NULL || values == NULL
+            || fread(rowStarts, sizeof(uint64_t), rows + 1, f) != rows + 1
+            || fread(colIndices, sizeof(uint32_t), (size_t)nnz, f) != nnz
+            || fread(values, sizeof(double), (size_t)nnz, f) != nnz
+            || rowStarts[0] != 0 || rowStarts[rows] != nnz;
+        for (size_t row = 0; row < rows && !failed; row++) {
+            if (rowStarts[row] > rowStarts[row + 1]) { failed = 1; break; }
+            for (uint64_t j = rowStarts[row]; j < rowStarts[row + 1]; j++) {
+                if (colIndices[j] >= cols) { failed = 1; break; }
+                net->weights[layer][(row * cols) + colIndices[j]] = values[j];
+            }
+        }
+        free(values);
+        free(colIndices);
+        free(rowStarts);
+        if (failed) return 1;
+    }
+    return 0;
+}
+
+// Reads the bfloat16 weights section of a `.nn` file into `net->bf16_weights`, widening them into `net->weights`; returns 0 on success, 1 on failure
+static int ReadBf16Weights(FILE *f, Network *net) {
+    memset(net->all_weights, 0, net->total_weight_count * sizeof(double)); // so rounding them for `BuildBf16Weights()` reads nothing uninitialised
+    if (BuildBf16Weights(net)) return 1;
+    if (fread(net->all_bf16_weights, sizeof(uint16_t), net->total_weight_count, f) != net->total_weight_count) return 1;
+    for (size_t i = 0; i < net->total_weight_count; i++) {
+        uint32_t bits = (uint32_t)net->all_bf16_weights[i] << 16;
+        float weight;
+        memcpy(&weight, &bits, sizeof(weight));
+        net->all_weights[i] = weight;
+    }
+    return 0;
+}
+
+// Returns 0 on success, 1 on failure
+// Reads any `.nn` format; networks saved sparse also get `net->sparse_weights` built, so they run with the sparse kernels,
+// and networks saved as bfloat16 get `net->bf16_weights` built (holding exactly the saved weights), so they run with the bfloat16 kernels
+// `net` is allocated by this function and must be freed with `FreeNetwork()` if and only if this function succeeds
+//
+// NOTE: files saved on a platform with a different endianness or `sizeof(double)` are rejected
+int LoadNetwork(const char *filename, Network *net) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return 1;
+    uint16_t format;
+    uint64_t inputSize;
+    uint64_t layers_count_64;
+    uint64_t convHeader[3] = { 1, 0, 0 }; // input rows, input cols, conv/pool layers count
+    ConvLayer *conv_layers = NULL;
+    size_t *layer_lengths = NULL;
+    if (fread(&format, sizeof(uint16_t), 1, f) != 1) goto fReadError;
+    bool hasConv = (format & NN_FORMAT_CONV) != 0;
+    format &= ~NN_FORMAT_CONV;
+    if (format != NN_FORMAT_DENSE && format != NN_FORMAT_SPARSE && format != NN_FORMAT_BF16) goto fReadError;
+    if (fread(&inputSize, sizeof(uint64_t), 1, f) != 1 || inputSize == 0 || inputSize > SIZE_MAX) goto fReadError;
+    convHeader[1] = inputSize;
+    if (hasConv) {
+        if (fread(convHeader, sizeof(uint64_t), 3, f) != 3 || convHeader[0] == 0 || convHeader[1] == 0 || convHeader[0] > inputSize / convHeader[1]) goto fReadError;
+        if (convHeader[0] * convHeader[1] != inputSize || convHeader[2] == 0 || convHeader[2] > SIZE_MAX / sizeof(ConvLayer)) goto fReadError;
+        conv_layers = calloc((size_t)convHeader[2], sizeof(ConvLayer));
+        if (conv_layers == NULL) goto fReadError;
+        for (size_t i = 0; i < convHeader[2]; i++) {
+            uint64_t fields[CONV_LAYER_FIELDS];
+            if (fread(fields, sizeof(uint64_t), CONV_LAYER_FIELDS, f) != CONV_LAYER_FIELDS || fields[0] > AVG_POOL_LAYER) goto fReadError;
+            if (fields[1] > inputSize || fields[2] > inputSize || fields[3] > SIZE_MAX / inputSize) goto fReadError; // `AllocConvNetwork()` checks the rest
+            conv_layers[i].type = (int)fields[0];
+            conv_layers[i].kernel = (size_t)fields[1];
+            conv_layers[i].stride = (size_t)fields[2];
+            conv_layers[i].filters = (size_t)fields[3];
+        }
+    }
+    if (fread(&layers_count_64, sizeof(uint64_t), 1, f) != 1 || layers_count_64 == 0 || layers_count_64 > SIZE_MAX / sizeof(size_t)) goto fReadError;
+    size_t layers_count = (size_t)layers_count_64;
+    layer_lengths = malloc(layers_count * sizeof(size_t));
+    if (layer_lengths == NULL) goto fReadError;
+    for (size_t i = 0; i < layers_count; i++) {
+        uint64_t length;
+        if (fread(&length, sizeof(uint64_t), 1, f) != 1 || length == 0 || length > SIZE_MAX) goto fReadError;
+        layer_lengths[i] = (size_t)length;
+    }
+    uint64_t double_size;
+    if (fread(&double_size, sizeof(uint64_t), 1, f) != 1 || double_size != sizeof(double)) goto fReadError;
+    if (AllocConvNetwork(net, (size_t)convHeader[0], (size_t)convHeader[1], (size_t)convHeader[2], conv_layers, layers_count, layer_lengths)) goto fReadError;
+    free(layer_lengths);
+    free(conv_layers);
+    int failed = (net->total_conv_param_count > 0 && fread(net->all_conv_params, sizeof(double), net->total_conv_param_count, f) != net->total_conv_param_count)
+        || (format == NN_FORMAT_DENSE && fread(net->all_weights, sizeof(double), net->total_weight_count, f) != net->total_weight_count)
+        || (format == NN_FORMAT_SPARSE && ReadSparseWeights(f, net))
+        || (format == NN_FORMAT_BF16 && ReadBf16Weights(f, net));
+    if (failed
+        || fread(net->all_biases, sizeof(double), net->total_neuron_count, f) != net->total_neuron_count
+        || (format == NN_FORMAT_SPARSE && BuildSparseWeights(net))) {
+        FreeNetwork(net);
+        (void)fclose(f);
+        return 1;
+    }
+    (void)fclose(f);
+    return 0;
+    fReadError:
+    free(layer_lengths);
+    free(conv_layers);
+    (void)fclose(f);
+    return 1;
 }
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "main.h"
+
+/*
+    Incremental fine-tuning: resumes training a saved `.nn` network on newly appended IDX shards, rather than retraining from scratch
+
+    Each step trains on a mix of the new images and a random replay sample of the config file's training set, so the network
+    learns the new data without forgetting the old; the number of samples trained on is bounded by `--steps * --batch`
+    Accuracy on the config file's test set (and on the new data) is reported before and after
+*/
+
+#define DEFAULT_REPLAY_RATIO 0.5
+#define DEFAULT_PASSES 1
+#define MAX_SHARDS 16
+
+typedef struct Shard {
+    char **images;
+    char *labels;
+    size_t count;
+} Shard;
+
+// Returns the fraction of `count` images `net` classifies correctly
+static double Accuracy(const Network *net, NetworkScratch *scratch, size_t count, char **images, char *labels) {
+    return count == 0 ? 0.0 : (double)Evaluate(net, scratch, count, images, labels, NULL) / count;
+}
+
+// Shuffles `images` and `labels` together (Fisher-Yates); uses `rand()`
+static void Shuffle(size_t count, char **images, char *labels) {
+    for (size_t i = count; i > 1; i--) {
+        size_t j = (size_t)rand() % i;
+        char *image = images[i - 1];
+        images[i - 1] = images[j];
+        images[j] = image;
+        char label = labels[i - 1];
+        labels[i - 1] = labels[j];
+        labels[j] = label;
+    }
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s MODEL.nn NEW-IMAGES.idx3-ubyte NEW-LABELS.idx1-ubyte [NEW-IMAGES NEW-LABELS ...] [options]\n"
+        "\t--output FILE          where to save the fine-tuned network (default: not saved)\n"
+        "\t--replay-ratio R       old training images replayed per new image (default %g)\n"
+        "\t--steps N              most steps of gradient descent to take (default: %d pass(es) over the new and replayed images)\n"
+        "\t--batch N              images per step (default 1)\n"
+        "\t--learning-rate R      fine-tuning learning rate (default: the config file's)\n"
+        "\t--seed N               seed for the replay sample and shuffling (default: the time)\n",
+        program, DEFAULT_REPLAY_RATIO, DEFAULT_PASSES);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char *modelFilename = argv[1];
+    const char *shardFilenames[MAX_SHARDS][2];
+    size_t shardCount = 0;
+    int arg = 2;
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) != 0; arg += 2) {
+        if (shardCount == MAX_SHARDS) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        shardFilenames[shardCount][0] = argv[arg];
+        shardFilenames[shardCount][1] = argv[arg + 1];
+        shardCount++;
+    }
+    const char *outputFilename = NULL;
+    double replayRatio = DEFAULT_REPLAY_RATIO;
+    size_t steps = 0; // 0 means `DEFAULT_PASSES` passes
+    size_t batchSize = 1;
+    double learningRate = 0.0;
+    size_t seed = (size_t)time(NULL);
+    for (; arg < argc; arg++) {
+        bool valid = shardCount > 0 && arg + 1 < argc;
+        if (valid && strcmp(argv[arg], "--output") == 0) {
+            outputFilename = argv[++arg];
+        } else if (valid && strcmp(argv[arg], "--replay-ratio") == 0) {
+            valid = ParseNumberArg(argv[++arg], 0.0, &replayRatio);
+        } else if (valid && strcmp(argv[arg], "--steps") == 0) {
+            valid = ParseSizeArg(argv[++arg], 1, &steps);
+        } else if (valid && strcmp(argv[arg], "--batch") == 0) {
+            valid = ParseSizeArg(argv[++arg], 1, &batchSize);
+        } else if (valid && strcmp(argv[arg], "--learning-rate") == 0) {
+            valid = ParseNumberArg(argv[++arg], 0.0, &learningRate) && learningRate > 0.0;
+        } else if (valid && strcmp(argv[arg], "--seed") == 0) {
+            valid = ParseSizeArg(argv[++arg], 0, &seed);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    char training_images_filename[MAX_PATH] = { 0 };
+    char training_labels_filename[MAX_PATH] = { 0 };
+    char testing_images_filename[MAX_PATH] = { 0 };
+    char testing_labels_filename[MAX_PATH] = { 0 };
+    char **images = NULL;
+    char *imageData = NULL; // `images[0]` before the replay sample reorders `images`
+    char *labels = NULL;
+    char **test_images = NULL;
+    char *test_labels = NULL;
+    Shard shards[MAX_SHARDS] = { { 0 } };
+    char **mixedImages = NULL; // points into the shards and the old training set; never owns images
+    char *mixedLabels = NULL;
+    Network network = { 0 };
+    TrainingScratch trainingScratch = { 0 };
+    NetworkScratch testingScratch = { 0 };
+
+    // only the datasets and learning rate are used; the architecture comes from the model
+    if (GetDatasetConfig(CONFIG_FILENAME, training_images_filename, training_labels_filename, testing_images_filename, testing_labels_filename, &learningRate, NULL)) {
+        fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (learningRate <= 0.0) {
+        fprintf(stderr, "No learning rate given with --learning-rate or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    if (LoadNetwork(modelFilename, &network)) {
+        fprintf(stderr, "Failed to load network from file \"%s\".\n", modelFilename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    // a pruned network stays pruned; it's trained dense (masked) and saved sparse again
+    bool sparse = network.sparse_weights != NULL;
+    if (sparse) {
+        FreeSparseWeights(&network);
+        if (AllocMasks(&network)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for pruning masks.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+    // a bfloat16 network is trained in mixed precision on its bfloat16 weights (see `TrainEpoch()`), and saved as bfloat16 again
+    bool bf16 = network.bf16_weights != NULL;
+
+    /* RETRIEVE DATA */
+
+    uint32_t image_count, label_count, row_count, col_count;
+    size_t newCount = 0;
+    for (size_t i = 0; i < shardCount; i++) {
+        shards[i].images = GetImages(shardFilenames[i][0], &image_count, &row_count, &col_count);
+        shards[i].labels = GetLabels(shardFilenames[i][1], &label_count);
+        if (shards[i].images == NULL || shards[i].labels == NULL || (size_t)row_count * col_count != network.input_size) {
+            fprintf(stderr, "Failed to retrieve new data matching the network from files \"%s\" and \"%s\".\n", shardFilenames[i][0], shardFilenames[i][1]);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        shards[i].count = image_count < label_count ? image_count : label_count;
+        newCount += shards[i].count;
+    }
+    // the old training set is only needed to replay from
+    size_t oldCount = 0;
+    size_t replayCount = (size_t)(replayRatio * (double)newCount);
+    if (replayCount > 0) {
+        images = GetImages(training_images_filename, &image_count, &row_count, &col_count);
+        labels = GetLabels(training_labels_filename, &label_count);
+        if (images == NULL || labels == NULL || (size_t)row_count * col_count != network.input_size) {
+            fprintf(stderr, "Failed to retrieve old training data matching the network from files \"%s\" and \"%s\".\n", training_images_filename, training_labels_filename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        imageData = images[0];
+        oldCount = image_count < label_count ? image_count : label_count;
+        if (replayCount > oldCount) replayCount = oldCount;
+    }
+    uint32_t test_image_count, test_label_count;
+    test_images = GetImages(testing_images_filename, &test_image_count, &row_count, &col_count);
+    test_labels = GetLabels(testing_labels_filename, &test_label_count);
+    if (test_images == NULL || test_labels == NULL || (size_t)row_count * col_count != network.input_size) {
+        fprintf(stderr, "Failed to retrieve testing data matching the network from files \"%s\" and \"%s\".\n", testing_images_filename, testing_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t testingCount = test_image_count < test_label_count ? test_image_count : test_label_count;
+
+    // the new images come first, so they can also be evaluated together before shuffling
+    size_t mixedCount = newCount + replayCount;
+    mixedImages = malloc(mixedCount * sizeof(char*));
+    mixedLabels = malloc(mixedCount);
+    if (mixedImages == NULL || mixedLabels == NULL) {
+        fprintf(stderr, "Failed to allocate memory on the heap for the training mix.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < shardCount; i++) {
+        memcpy(&mixedImages[offset], shards[i].images, shards[i].count * sizeof(char*));
+        memcpy(&mixedLabels[offset], shards[i].labels, shards[i].count);
+        offset += shards[i].count;
+    }
+    // replay a random sample of the old training set without repeats, by taking the end of a partial shuffle of its indices
+    srand((unsigned int)seed);
+    for (size_t i = 0; i < replayCount; i++) {
+        size_t j = i + ((size_t)rand() % (oldCount - i));
+        char *image = images[i];
+        images[i] = images[j];
+        images[j] = image;
+        char label = labels[i];
+        labels[i] = labels[j];
+        labels[j] = label;
+        mixedImages[newCount + i] = images[i];
+        mixedLabels[newCount + i] = labels[i];
+    }
+
+    if (AllocTrainingScratch(&trainingScratch, &network, batchSize, 0) || AllocScratch(&testingScratch, &network, TESTING_BATCH_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t sampleLimit = steps > 0 ? steps * batchSize : DEFAULT_PASSES * mixedCount;
+
+    /* FINE-TUNE */
+
+    double testBefore = Accuracy(&network, &testingScratch, testingCount, test_images, test_labels);
+    double newBefore = Accuracy(&network, &testingScratch, newCount, mixedImages, mixedLabels);
+    printf("Fine-tuning \"%s\" on %zu new images from %zu shard(s) and %zu replayed from \"%s\", at learning rate %g\n",
+        modelFilename, newCount, shardCount, replayCount, training_images_filename, learningRate);
+    printf("Training on %zu samples in batches of %zu (%zu steps)\n", sampleLimit, batchSize, (sampleLimit + batchSize - 1) / batchSize);
+    fflush(stdout);
+
+    double start = GetMonotonicTime();
+    for (size_t trained = 0; trained < sampleLimit;) {
+        // a fresh order for every pass over the mix
+        Shuffle(mixedCount, mixedImages, mixedLabels);
+        size_t count = sampleLimit - trained < mixedCount ? sampleLimit - trained : mixedCount;
+        TrainEpoch(&network, &trainingScratch, count, mixedImages, mixedLabels, learningRate);
+        trained += count;
+    }
+    double elapsed = GetMonotonicTime() - start;
+
+    // the new images are no longer at the front of the mix
+    double newAfter = 0.0;
+    for (size_t i = 0; i < shardCount; i++) {
+        newAfter += Accuracy(&network, &testingScratch, shards[i].count, shards[i].images, shards[i].labels) * shards[i].count;
+    }
+    newAfter /= newCount;
+    double testAfter = Accuracy(&network, &testingScratch, testingCount, test_images, test_labels);
+
+    printf("\n| Data                | Before | After  | Delta   |\n");
+    printf("| ------------------- | ------ | ------ | ------- |\n");
+    printf("| Test set (%6zu)   | %.4f | %.4f | %+.4f |\n", testingCount, testBefore, testAfter, testAfter - testBefore);
+    printf("| New images (%6zu) | %.4f | %.4f | %+.4f |\n", newCount, newBefore, newAfter, newAfter - newBefore);
+    printf("\nFine-tuned in %.2fs\n", elapsed);
+
+    if (outputFilename != NULL) {
+        if (sparse ? SaveSparseNetwork(outputFilename, &network) : bf16 ? SaveBf16Network(outputFilename, &network) : SaveNetwork(outputFilename, &network)) {
+            fprintf(stderr, "Failed to write to the file \"%s\".\n", outputFilename);
+            returnValue = 1;
+        } else {
+            printf("Saved to \"%s\".\n", outputFilename);
+        }
+    }
+
+    CleanupLabel:
+
+    FreeScratch(&testingScratch);
+    FreeTrainingScratch(&trainingScratch);
+    FreeNetwork(&network);
+    free(mixedLabels);
+    free(mixedImages);
+    for (size_t i = 0; i < shardCount; i++) {
+        free(shards[i].labels);
+        if (shards[i].images != NULL) free(shards[i].images[0]);
+        free(shards[i].images);
+    }
+    free(test_labels);
+    if (test_images != NULL) free(test_images[0]);
+    free(test_images);
+    free(labels);
+    free(imageData);
+    free(images);
+    return returnValue;
+}
\ No newline at end of file
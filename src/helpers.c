@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
+#include "network.h"
 
 /*
     Contains a bunch of helper functions related to the actual learning and matrix operations
@@ -92,18 +93,175 @@ void TransformVector(size_t width, size_t height, double *matrix, double *invect
     }
 }
 
+// `outvector = (matrix)^T(invector)`
+// `matrix` should be row-major; `invector` is `height` long and `outvector` is `width` long
+void TransformVectorTransposed(size_t width, size_t height, double *matrix, double *invector, double *outvector) {
+    for (size_t j = 0; j < width; j++) outvector[j] = 0.0;
+    for (size_t i = 0; i < height; i++) {
+        double scale = invector[i];
+        double *matrix_row = &matrix[i * width];
+        for (size_t j = 0; j < width; j++) {
+            outvector[j] += matrix_row[j] * scale;
+        }
+    }
+}
+
+// `outmatrix = (matrix)(inmatrix)` for each of `batch` samples
+// `matrix` should be row-major; `inmatrix` holds one `width` long sample per row and `outmatrix` one `height` long result per row
+//
+// `tile` columns of `matrix` are done at a time (0 does whole rows), so four samples' worth of them stay in cache across every row
+//
+// NOTE: four samples are processed per pass over `matrix`, so each weight is loaded from memory once per four samples instead of once per sample
+//       each sum carries on from the previous tile's, so the result doesn't depend on `tile`
+void TransformBatch(size_t width, size_t height, size_t batch, double *matrix, double *inmatrix, double *outmatrix, size_t tile) {
+    if (tile == 0 || tile > width) tile = width;
+    size_t b = 0;
+    for (; b + 4 <= batch; b += 4) {
+        double *in0 = &inmatrix[(b + 0) * width];
+        double *in1 = &inmatrix[(b + 1) * width];
+        double *in2 = &inmatrix[(b + 2) * width];
+        double *in3 = &inmatrix[(b + 3) * width];
+        for (size_t start = 0; start < width; start += tile) {
+            size_t end = width - start > tile ? start + tile : width;
+            for (size_t i = 0; i < height; i++) {
+                double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+                if (start > 0) {
+                    sum0 = outmatrix[((b + 0) * height) + i];
+                    sum1 = outmatrix[((b + 1) * height) + i];
+                    sum2 = outmatrix[((b + 2) * height) + i];
+                    sum3 = outmatrix[((b + 3) * height) + i];
+                }
+                double *matrix_row = &matrix[i * width];
+                for (size_t j = start; j < end; j++) {
+                    double weight = matrix_row[j];
+                    sum0 += weight * in0[j];
+                    sum1 += weight * in1[j];
+                    sum2 += weight * in2[j];
+                    sum3 += weight * in3[j];
+                }
+                outmatrix[((b + 0) * height) + i] = sum0;
+                outmatrix[((b + 1) * height) + i] = sum1;
+                outmatrix[((b + 2) * height) + i] = sum2;
+                outmatrix[((b + 3) * height) + i] = sum3;
+            }
+        }
+    }
+    for (; b < batch; b++) TransformVector(width, height, matrix, &inmatrix[b * width], &outmatrix[b * height]);
+}
+
+// `outmatrix = (matrix)^T(inmatrix)` for each of `batch` samples
+// `inmatrix` holds one `height` long sample per row and `outmatrix` one `width` long result per row
+// `tile` rows of `matrix` are done at a time for every sample (0 does the whole matrix per sample), so they stay in cache across the batch
+//
+// NOTE: each output is summed in the same order whatever `tile` is, so the result doesn't depend on it
+void TransformBatchTransposed(size_t width, size_t height, size_t batch, double *matrix, double *inmatrix, double *outmatrix, size_t tile) {
+    if (tile == 0 || tile > height) tile = height;
+    for (size_t j = 0; j < batch * width; j++) outmatrix[j] = 0.0;
+    for (size_t start = 0; start < height; start += tile) {
+        size_t end = height - start > tile ? start + tile : height;
+        for (size_t b = 0; b < batch; b++) {
+            double *outvector = &outmatrix[b * width];
+            for (size_t i = start; i < end; i++) {
+                double scale = inmatrix[(b * height) + i];
+                double *matrix_row = &matrix[i * width];
+                for (size_t j = 0; j < width; j++) {
+                    outvector[j] += matrix_row[j] * scale;
+                }
+            }
+        }
+    }
+}
+
+// `outmatrix = (matrix)(inmatrix)` for each of `batch` samples, with a sparse `matrix`
+// `inmatrix` holds one `matrix->cols` long sample per row and `outmatrix` one `matrix->rows` long result per row
+//
+// NOTE: like `TransformBatch()`, four samples are processed per pass over `matrix`
+void SparseTransformBatch(const CsrMatrix *matrix, size_t batch, double *inmatrix, double *outmatrix) {
+    size_t width = matrix->cols;
+    size_t height = matrix->rows;
+    size_t b = 0;
+    for (; b + 4 <= batch; b += 4) {
+        double *in0 = &inmatrix[(b + 0) * width];
+        double *in1 = &inmatrix[(b + 1) * width];
+        double *in2 = &inmatrix[(b + 2) * width];
+        double *in3 = &inmatrix[(b + 3) * width];
+        for (size_t i = 0; i < height; i++) {
+            double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+            for (size_t j = matrix->row_starts[i]; j < matrix->row_starts[i + 1]; j++) {
+                double weight = matrix->values[j];
+                uint32_t col = matrix->col_indices[j];
+                sum0 += weight * in0[col];
+                sum1 += weight * in1[col];
+                sum2 += weight * in2[col];
+                sum3 += weight * in3[col];
+            }
+            outmatrix[((b + 0) * height) + i] = sum0;
+            outmatrix[((b + 1) * height) + i] = sum1;
+            outmatrix[((b + 2) * height) + i] = sum2;
+            outmatrix[((b + 3) * height) + i] = sum3;
+        }
+    }
+    for (; b < batch; b++) {
+        double *invector = &inmatrix[b * width];
+        for (size_t i = 0; i < height; i++) {
+            double sum = 0.0;
+            for (size_t j = matrix->row_starts[i]; j < matrix->row_starts[i + 1]; j++) {
+                sum += matrix->values[j] * invector[matrix->col_indices[j]];
+            }
+            outmatrix[(b * height) + i] = sum;
+        }
+    }
+}
+
 // Performs gradient descent
-void Descend(size_t layers_count, size_t *layer_lengths, size_t inputSize, double *inputLayer, double **activated_neurons, double **weights, double **biases, double **biasesJacobian, double learningRate) {
+// `masks` may be NULL; otherwise weights with a mask of 0 are left untouched
+void Descend(size_t layers_count, size_t *layer_lengths, size_t inputSize, double *inputLayer, double **activated_neurons, double **weights, double **biases, double **biasesJacobian, double learningRate, unsigned char **masks) {
     size_t weightsWidth = inputSize;
     double *prevLayer = inputLayer;
     for (size_t layer = 0; layer < layers_count; layer++) {
         for (size_t row = 0; row < layer_lengths[layer]; row++) {
-            for (size_t col = 0; col < weightsWidth; col++) {
-                weights[layer][(row * weightsWidth) + col] -= learningRate * prevLayer[col] * biasesJacobian[layer][row];
+            if (masks == NULL) {
+                for (size_t col = 0; col < weightsWidth; col++) {
+                    weights[layer][(row * weightsWidth) + col] -= learningRate * prevLayer[col] * biasesJacobian[layer][row];
+                }
+            } else {
+                // multiplying by the mask rather than branching on it keeps the loop vectorisable
+                unsigned char *mask_row = &masks[layer][row * weightsWidth];
+                for (size_t col = 0; col < weightsWidth; col++) {
+                    weights[layer][(row * weightsWidth) + col] -= learningRate * prevLayer[col] * biasesJacobian[layer][row] * mask_row[col];
+                }
             }
             biases[layer][row] -= learningRate * biasesJacobian[layer][row];
         }
         weightsWidth = layer_lengths[layer];
         prevLayer = activated_neurons[layer];
     }
+}
+
+// Performs gradient descent on one layer with the summed gradient of `batch` samples
+// `inputs` holds one `width` long sample of the layer's input per row, and `biasesJacobian` one `height` long sample per row
+// `mask` may be NULL; otherwise weights with a mask of 0 are left untouched
+// `tile` columns are done at a time (0 does whole rows), so the batch's inputs for them stay in cache across every row
+//
+// NOTE: each weight is stepped by the samples in the same order whatever `tile` is, so the result doesn't depend on it
+void DescendBatch(size_t width, size_t height, size_t batch, double *inputs, double *weights, double *biases, double *biasesJacobian, double learningRate, unsigned char *mask, size_t tile) {
+    if (tile == 0 || tile > width) tile = width;
+    for (size_t start = 0; start < width; start += tile) {
+        size_t end = width - start > tile ? start + tile : width;
+        for (size_t row = 0; row < height; row++) {
+            double *weights_row = &weights[row * width];
+            for (size_t b = 0; b < batch; b++) {
+                double step = learningRate * biasesJacobian[(b * height) + row];
+                if (step == 0.0) continue;
+                double *input = &inputs[b * width];
+                if (mask == NULL) {
+                    for (size_t col = start; col < end; col++) weights_row[col] -= step * input[col];
+                } else {
+                    unsigned char *mask_row = &mask[row * width];
+                    for (size_t col = start; col < end; col++) weights_row[col] -= step * input[col] * mask_row[col];
+                }
+                if (start == 0) biases[row] -= step;
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "main.h"
+
+/*
+    Contains versions of the single-sample kernels that split each operator's rows across a `WorkPool`
+
+    Batching doesn't help a single sample, so instead the rows of each layer are split across cores. Chunks are sized so each
+    one is worth claiming, and layers too small to be worth splitting at all run serially, so passing a pool never makes a
+    narrow network slower than passing NULL
+*/
+
+#define MIN_CHUNK_WORK 4096 // multiply-adds per chunk
+#define MIN_PARALLEL_WORK 32768 // multiply-adds in an operator for it to be split at all
+#define CHUNKS_PER_THREAD 4 // so threads that finish early have something to steal
+
+// Returns the rows per chunk to split `rows` rows of `workPerRow` multiply-adds each across `pool` with, or `rows` to run serially
+static size_t ChooseGrain(const WorkPool *pool, size_t rows, size_t workPerRow) {
+    size_t threads = pool == NULL ? 1 : WorkPoolSize(pool);
+    if (threads == 1 || workPerRow == 0 || rows * workPerRow < MIN_PARALLEL_WORK) return rows;
+    size_t grain = (MIN_CHUNK_WORK + workPerRow - 1) / workPerRow;
+    size_t balanced = (rows + (threads * CHUNKS_PER_THREAD) - 1) / (threads * CHUNKS_PER_THREAD);
+    return grain > balanced ? grain : balanced;
+}
+
+typedef struct TransformContext {
+    size_t width;
+    double *matrix;
+    double *invector;
+    double *outvector;
+} TransformContext;
+
+static void TransformRowsTask(void *context, size_t worker, size_t begin, size_t end) {
+    TransformContext *ctx = context;
+    (void)worker;
+    TransformVector(ctx->width, end - begin, &ctx->matrix[begin * ctx->width], ctx->invector, &ctx->outvector[begin]);
+}
+
+// `outvector = (matrix)(invector)`, with the rows split across `pool`
+// `pool` may be NULL, which is the same as `TransformVector()`
+void TransformVectorParallel(WorkPool *pool, size_t width, size_t height, double *matrix, double *invector, double *outvector) {
+    size_t grain = ChooseGrain(pool, height, width);
+    if (grain >= height) {
+        TransformVector(width, height, matrix, invector, outvector);
+        return;
+    }
+    TransformContext ctx = { width, matrix, invector, outvector };
+    WorkPoolFor(pool, height, grain, TransformRowsTask, &ctx);
+}
+
+// Performs a forward pass on the network, with each layer split across `pool` (see `ForwardPass()`)
+void ForwardPassParallel(WorkPool *pool, size_t inputLayerSize, double *inputLayer, size_t layers_count, size_t *layer_lengths, double **weights, double **biases,
+    double **deactivated_neurons, double **activated_neurons) {
+    size_t prevLength = inputLayerSize;
+    double *prevLayer = inputLayer;
+    for (size_t layer = 0; layer < layers_count; layer++) {
+        TransformVectorParallel(pool, prevLength, layer_lengths[layer], weights[layer], prevLayer, deactivated_neurons[layer]);
+        AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
+        // the last layer uses a different activation function
+        if (layer == layers_count - 1) {
+            ActivateOutputVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
+        } else {
+            ActivateVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
+        }
+        prevLength = layer_lengths[layer];
+        prevLayer = activated_neurons[layer];
+    }
+}
+
+typedef struct BackPropagateContext {
+    size_t length; // of the layer being found
+    size_t nextLength;
+    double *nextWeights;
+    double *nextJacobian;
+    double *jacobian;
+} BackPropagateContext;
+
+static void BackPropagateRowsTask(void *context, size_t worker, size_t begin, size_t end) {
+    BackPropagateContext *ctx = context;
+    (void)worker;
+    for (size_t row = begin; row < end; row++) {
+        double sum = 0.0;
+        for (size_t i = 0; i < ctx->nextLength; i++) sum += ctx->nextJacobian[i] * ctx->nextWeights[(i * ctx->length) + row];
+        ctx->jacobian[row] *= sum;
+    }
+}
+
+// Propagates backwards through the network and acquires jacobians, with each layer's rows split across `pool` (see `BackPropagate()`)
+void BackPropagateParallel(WorkPool *pool, size_t layers_count, size_t *layer_lengths, double **weights, double **deactivated_neurons, double **activated_neurons,
+    double *intended, double **biasJacobian) {
+    size_t layer = layers_count - 1;
+    CostPrimeWrtDeactivated(layer_lengths[layer], biasJacobian[layer], activated_neurons[layer], intended);
+    while (layer-- > 0) {
+        ActivationPrime(layer_lengths[layer], biasJacobian[layer], deactivated_neurons[layer]);
+        BackPropagateContext ctx = { layer_lengths[layer], layer_lengths[layer + 1], weights[layer + 1], biasJacobian[layer + 1], biasJacobian[layer] };
+        WorkPoolFor(pool, layer_lengths[layer], ChooseGrain(pool, layer_lengths[layer], layer_lengths[layer + 1]), BackPropagateRowsTask, &ctx);
+    }
+}
+
+typedef struct DescendContext {
+    size_t width;
+    double *prevLayer;
+    double *weights;
+    double *biases;
+    double *jacobian;
+    double learningRate;
+    unsigned char *mask; // may be NULL
+} DescendContext;
+
+static void DescendRowsTask(void *context, size_t worker, size_t begin, size_t end) {
+    DescendContext *ctx = context;
+    (void)worker;
+    for (size_t row = begin; row < end; row++) {
+        // same order of operations as `Descend()`, so results don't depend on the pool
+        double *weights_row = &ctx->weights[row * ctx->width];
+        if (ctx->mask == NULL) {
+            for (size_t col = 0; col < ctx->width; col++) weights_row[col] -= ctx->learningRate * ctx->prevLayer[col] * ctx->jacobian[row];
+        } else {
+            unsigned char *mask_row = &ctx->mask[row * ctx->width];
+            for (size_t col = 0; col < ctx->width; col++) weights_row[col] -= ctx->learningRate * ctx->prevLayer[col] * ctx->jacobian[row] * mask_row[col];
+        }
+        ctx->biases[row] -= ctx->learningRate * ctx->jacobian[row];
+    }
+}
+
+// Performs gradient descent, with each layer's rows split across `pool` (see `Descend()`)
+void DescendParallel(WorkPool *pool, size_t layers_count, size_t *layer_lengths, size_t inputSize, double *inputLayer, double **activated_neurons, double **weights, double **biases,
+    double **biasesJacobian, double learningRate, unsigned char **masks) {
+    size_t weightsWidth = inputSize;
+    double *prevLayer = inputLayer;
+    for (size_t layer = 0; layer < layers_count; layer++) {
+        DescendContext ctx = { weightsWidth, prevLayer, weights[layer], biases[layer], biasesJacobian[layer], learningRate, masks == NULL ? NULL : masks[layer] };
+        WorkPoolFor(pool, layer_lengths[layer], ChooseGrain(pool, layer_lengths[layer], weightsWidth), DescendRowsTask, &ctx);
+        weightsWidth = layer_lengths[layer];
+        prevLayer = activated_neurons[layer];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "main.h"
+
+/*
+    Single-sample latency benchmark: times one forward pass, and one training step, of one sample through dense networks of
+    several widths, with each layer split across work-stealing pools of several sizes (see `intraop.c`)
+
+    Networks are randomly initialised and fed random pixels, so no datasets are needed
+*/
+
+#define DEFAULT_DEPTH 2
+#define DEFAULT_INPUT_SIZE 784
+#define DEFAULT_SECONDS 0.5
+#define MAX_VALUES 16
+#define MAX_SAMPLES 1000000
+#define OUTPUT_SIZE 10
+
+typedef struct LatencyResult {
+    double forward_p50;
+    double forward_p99;
+    double train_p50;
+} LatencyResult;
+
+// Times single-sample forward passes and training steps for about `seconds` each
+static void Measure(Network *net, NetworkScratch *scratch, TrainingScratch *training, char **image, char *label, double seconds, LatencyStats *stats, LatencyResult *result) {
+    // warm the caches and wake the pool
+    for (size_t i = 0; i < 10; i++) ForwardPassBatch(net, 1, scratch->inputs, scratch);
+    ResetLatencyStats(stats);
+    for (double begin = GetMonotonicTime(), now = begin; now - begin < seconds && stats->count < stats->capacity;) {
+        double start = GetMonotonicTime();
+        ForwardPassBatch(net, 1, scratch->inputs, scratch);
+        now = GetMonotonicTime();
+        RecordLatency(stats, now - start);
+    }
+    result->forward_p50 = LatencyPercentile(stats, 0.50);
+    result->forward_p99 = LatencyPercentile(stats, 0.99);
+    ResetLatencyStats(stats);
+    for (double begin = GetMonotonicTime(), now = begin; now - begin < seconds && stats->count < stats->capacity;) {
+        double start = GetMonotonicTime();
+        // a learning rate of 0 does all the work of a step but leaves the network as it is
+        TrainEpoch(net, training, 1, image, label, 0.0);
+        now = GetMonotonicTime();
+        RecordLatency(stats, now - start);
+    }
+    result->train_p50 = LatencyPercentile(stats, 0.50);
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\t--widths LIST          comma-separated hidden layer widths (default 64,256,1024,2048)\n"
+        "\t--threads LIST         comma-separated pool sizes; 1 is serial (default 1, 2, 4, ... up to the core count)\n"
+        "\t--depth N              hidden layers per network (default %d)\n"
+        "\t--input N              input layer size (default %d)\n"
+        "\t--seconds S            time spent measuring each operation per cell (default %g)\n",
+        program, DEFAULT_DEPTH, DEFAULT_INPUT_SIZE, DEFAULT_SECONDS);
+}
+
+int main(int argc, char **argv) {
+    size_t widths[MAX_VALUES] = { 64, 256, 1024, 2048 };
+    size_t widthCount = 4;
+    size_t threadCounts[MAX_VALUES];
+    size_t threadCountCount = 0;
+    size_t depth = DEFAULT_DEPTH;
+    size_t inputSize = DEFAULT_INPUT_SIZE;
+    double seconds = DEFAULT_SECONDS;
+    for (int i = 1; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--widths") == 0) {
+            valid = ParseSizeList(argv[++i], 1, widths, MAX_VALUES, &widthCount);
+        } else if (valid && strcmp(argv[i], "--threads") == 0) {
+            valid = ParseSizeList(argv[++i], 1, threadCounts, MAX_VALUES, &threadCountCount);
+        } else if (valid && strcmp(argv[i], "--depth") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &depth);
+        } else if (valid && strcmp(argv[i], "--input") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &inputSize);
+        } else if (valid && strcmp(argv[i], "--seconds") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &seconds);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (threadCountCount == 0) {
+        size_t cores = GetCoreCount();
+        for (size_t threads = 1; threads < cores && threadCountCount < MAX_VALUES - 1; threads *= 2) threadCounts[threadCountCount++] = threads;
+        threadCounts[threadCountCount++] = cores;
+    }
+
+    int returnValue = 0;
+    size_t *layer_lengths = malloc((depth + 1) * sizeof(size_t));
+    char *pixels = malloc(inputSize);
+    char label = 0;
+    double *serialOutput = malloc(OUTPUT_SIZE * sizeof(double));
+    Network network = { 0 };
+    NetworkScratch scratch = { 0 };
+    TrainingScratch training = { 0 };
+    WorkPool *pool = NULL;
+    LatencyStats stats = { 0 };
+    if (layer_lengths == NULL || pixels == NULL || serialOutput == NULL || InitLatencyStats(&stats, MAX_SAMPLES)) {
+        fprintf(stderr, "Failed to allocate memory on the heap.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    srand(1);
+    for (size_t i = 0; i < inputSize; i++) pixels[i] = (char)(rand() % 256);
+
+    printf("Single-sample latency of %zu-input networks with %zu hidden layers and %zu outputs, on %zu cores\n\n", inputSize, depth, (size_t)OUTPUT_SIZE, GetCoreCount());
+    printf("| Width | Threads | Forward p50 (us) | Forward p99 (us) | Speedup | Train step p50 (us) | Speedup |\n");
+    printf("| ----- | ------- | ---------------- | ---------------- | ------- | ------------------- | ------- |\n");
+    fflush(stdout);
+    for (size_t w = 0; w < widthCount; w++) {
+        for (size_t i = 0; i < depth; i++) layer_lengths[i] = widths[w];
+        layer_lengths[depth] = OUTPUT_SIZE;
+        FreeTrainingScratch(&training);
+        FreeScratch(&scratch);
+        FreeNetwork(&network);
+        if (AllocNetwork(&network, inputSize, depth + 1, layer_lengths) || AllocScratch(&scratch, &network, 1) || AllocTrainingScratch(&training, &network, 1, 0)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for a network of width %zu.\n", widths[w]);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        srand(1);
+        InitialiseNetwork(&network);
+        char *image = pixels;
+        LoadInputs(1, inputSize, &image, scratch.inputs);
+
+        LatencyResult serial = { 0 };
+        for (size_t t = 0; t < threadCountCount; t++) {
+            DestroyWorkPool(pool);
+            pool = threadCounts[t] > 1 ? CreateWorkPool(threadCounts[t]) : NULL;
+            if (threadCounts[t] > 1 && pool == NULL) {
+                fprintf(stderr, "Failed to start a pool of %zu threads.\n", threadCounts[t]);
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+            scratch.pool = pool;
+            training.forward.pool = pool;
+            LatencyResult result;
+            Measure(&network, &scratch, &training, &image, &label, seconds, &stats, &result);
+
+            // splitting rows never changes what each row computes
+            double *output = scratch.activated_neurons[depth];
+            if (t == 0) {
+                serial = result;
+                memcpy(serialOutput, output, OUTPUT_SIZE * sizeof(double));
+            } else if (memcmp(serialOutput, output, OUTPUT_SIZE * sizeof(double)) != 0) {
+                fprintf(stderr, "Output with %zu threads differs from the first run's.\n", threadCounts[t]);
+                returnValue = 1;
+            }
+            printf("| %5zu | %7zu | %16.2f | %16.2f | %6.2fx | %19.2f | %6.2fx |\n", widths[w], pool == NULL ? 1 : WorkPoolSize(pool),
+                result.forward_p50 * 1e6, result.forward_p99 * 1e6, serial.forward_p50 / result.forward_p50, result.train_p50 * 1e6, serial.train_p50 / result.train_p50);
+            fflush(stdout);
+        }
+    }
+
+    CleanupLabel:
+
+    DestroyWorkPool(pool);
+    FreeLatencyStats(&stats);
+    FreeTrainingScratch(&training);
+    FreeScratch(&scratch);
+    FreeNetwork(&network);
+    free(serialOutput);
+    free(pixels);
+    free(layer_lengths);
+    return returnValue;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "main.h"
+#include "nn.h"
+
+/*
+    Implements `libnn` (see `nn.h`) over the same network code the executables use
+
+    Only the functions in `nn.h` are exported; everything else in the library is hidden
+*/
+
+struct NNModel {
+    Network net;
+};
+
+struct NNContext {
+    const NNModel *model;
+    NetworkScratch scratch;
+};
+
+NNModel *NNLoadModel(const char *filename) {
+    NNModel *model = malloc(sizeof(NNModel));
+    if (model == NULL) return NULL;
+    if (LoadNetwork(filename, &model->net)) {
+        free(model);
+        return NULL;
+    }
+    return model;
+}
+
+void NNFreeModel(NNModel *model) {
+    if (model == NULL) return;
+    FreeNetwork(&model->net);
+    free(model);
+}
+
+size_t NNModelInputSize(const NNModel *model) {
+    return model->net.input_size;
+}
+
+size_t NNModelOutputSize(const NNModel *model) {
+    return model->net.layer_lengths[model->net.layers_count - 1];
+}
+
+NNContext *NNCreateContext(const NNModel *model, size_t max_batch) {
+    if (max_batch == 0) return NULL;
+    NNContext *ctx = malloc(sizeof(NNContext));
+    if (ctx == NULL) return NULL;
+    ctx->model = model;
+    if (AllocScratch(&ctx->scratch, &model->net, max_batch)) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void NNFreeContext(NNContext *ctx) {
+    if (ctx == NULL) return;
+    DestroyWorkPool(ctx->scratch.pool);
+    FreeScratch(&ctx->scratch);
+    free(ctx);
+}
+
+int NNSetContextThreads(NNContext *ctx, size_t threads) {
+    if (threads == 0) return 1;
+    WorkPool *pool = NULL;
+    if (threads > 1) {
+        pool = CreateWorkPool(threads);
+        if (pool == NULL) return 1;
+    }
+    DestroyWorkPool(ctx->scratch.pool);
+    ctx->scratch.pool = pool;
+    return 0;
+}
+
+size_t NNPredict(NNContext *ctx, const unsigned char *pixels, double *scores) {
+    size_t prediction;
+    NNPredictBatch(ctx, 1, pixels, &prediction, scores);
+    return prediction;
+}
+
+void NNPredictBatch(NNContext *ctx, size_t count, const unsigned char *pixels, size_t *predictions, double *scores) {
+    const Network *net = &ctx->model->net;
+    NetworkScratch *scratch = &ctx->scratch;
+    size_t input_size = net->input_size;
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    for (size_t start = 0; start < count; start += scratch->batch_capacity) {
+        size_t batch = count - start < scratch->batch_capacity ? count - start : scratch->batch_capacity;
+        // same scaling as `LoadInputs()`
+        const unsigned char *batchPixels = &pixels[start * input_size];
+        for (size_t i = 0; i < batch * input_size; i++) scratch->inputs[i] = (double)batchPixels[i] / UCHAR_MAX;
+        ForwardPassBatch(net, batch, scratch->inputs, scratch);
+        double *outputs = scratch->activated_neurons[net->layers_count - 1];
+        for (size_t b = 0; b < batch; b++) {
+            if (predictions != NULL) predictions[start + b] = ArgMax(output_size, &outputs[b * output_size]);
+        }
+        if (scores != NULL) memcpy(&scores[start * output_size], outputs, batch * output_size * sizeof(double));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,232 @@
+#define _POSIX_C_SOURCE 200809L
+#include "main.h"
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/*
+    Load generator for the inference server (`nnserve`)
+
+    Opens `--connections` connections, each of which sends a request, waits for its response and immediately sends the next
+    (closed loop) for `--duration` seconds; more connections trade latency for throughput as the server's batches fill up
+    Reports client-side throughput and latency percentiles, plus accuracy if `--labels` is given
+*/
+
+#define DEFAULT_ADDRESS "unix:nn.sock"
+#define DEFAULT_CONNECTIONS 1
+#define DEFAULT_DURATION 5.0 // seconds
+#define RANDOM_IMAGES_COUNT 1024
+#define LATENCY_SAMPLES_CAPACITY (1u << 20)
+
+typedef struct ClientArgs {
+    const char *address;
+    size_t index; // connection index; each connection starts at a different image
+    size_t connections;
+    double deadline;
+    char **images;
+    size_t image_count;
+    size_t input_size;
+    char *labels; // may be NULL
+    LatencyStats stats;
+    size_t right; // correct predictions, if `labels` is given
+    bool failed;
+} ClientArgs;
+
+static void *ClientThread(void *arg) {
+    ClientArgs *args = arg;
+    int fd = ConnectTo(args->address);
+    if (fd < 0) {
+        args->failed = true;
+        return NULL;
+    }
+    uint64_t header[2];
+    if (ReadFull(fd, header, sizeof(header)) || header[0] != args->input_size || header[1] == 0) {
+        args->failed = true;
+        (void)close(fd);
+        return NULL;
+    }
+    size_t response_size = sizeof(uint64_t) + (size_t)header[1] * sizeof(double);
+    unsigned char *response = malloc(response_size);
+    if (response == NULL) {
+        args->failed = true;
+        (void)close(fd);
+        return NULL;
+    }
+    for (size_t image = args->index % args->image_count; GetMonotonicTime() < args->deadline; image = (image + args->connections) % args->image_count) {
+        double sent = GetMonotonicTime();
+        if (WriteFull(fd, args->images[image], args->input_size) || ReadFull(fd, response, response_size)) {
+            args->failed = true;
+            break;
+        }
+        RecordLatency(&args->stats, GetMonotonicTime() - sent);
+        if (args->labels != NULL) {
+            uint64_t prediction;
+            memcpy(&prediction, response, sizeof(uint64_t));
+            if (prediction == (uint64_t)(unsigned char)args->labels[image]) args->right++;
+        }
+    }
+    free(response);
+    (void)close(fd);
+    return NULL;
+}
+
+// Returns 0 on success, 1 on failure
+// Connects to the server just to read the input size from its header, so random images can be made to match
+static int GetServerInputSize(const char *address, size_t *input_size) {
+    int fd = ConnectTo(address);
+    if (fd < 0) return 1;
+    uint64_t header[2];
+    int failed = ReadFull(fd, header, sizeof(header)) || header[0] == 0 || header[0] > UINT32_MAX;
+    (void)close(fd);
+    if (!failed) *input_size = (size_t)header[0];
+    return failed;
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\t--connect ADDRESS      unix:PATH, HOST:PORT or PORT (default \"%s\")\n"
+        "\t--connections N        concurrent closed-loop connections (default %d)\n"
+        "\t--duration S           seconds to run for (default %.0f)\n"
+        "\t--images FILE          IDX3 image file to send (default: random images of the server's input size)\n"
+        "\t--labels FILE          IDX1 label file matching --images, to report accuracy\n",
+        program, DEFAULT_ADDRESS, DEFAULT_CONNECTIONS, DEFAULT_DURATION);
+}
+
+int main(int argc, char **argv) {
+    const char *address = DEFAULT_ADDRESS;
+    size_t connections = DEFAULT_CONNECTIONS;
+    double duration = DEFAULT_DURATION;
+    const char *images_filename = NULL;
+    const char *labels_filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--connect") == 0) {
+            address = argv[++i];
+        } else if (valid && strcmp(argv[i], "--connections") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &connections);
+        } else if (valid && strcmp(argv[i], "--duration") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &duration);
+        } else if (valid && strcmp(argv[i], "--images") == 0) {
+            images_filename = argv[++i];
+        } else if (valid && strcmp(argv[i], "--labels") == 0) {
+            labels_filename = argv[++i];
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (labels_filename != NULL && images_filename == NULL) {
+        fprintf(stderr, "--labels requires --images.\n");
+        return 1;
+    }
+
+    int returnValue = 0;
+    char **images = NULL;
+    char *labels = NULL;
+    ClientArgs *clients = NULL;
+    pthread_t *threads = NULL;
+    LatencyStats total = { 0 };
+
+    uint32_t image_count = RANDOM_IMAGES_COUNT;
+    uint32_t row_count = 1;
+    uint32_t col_count = 0;
+    if (images_filename != NULL) {
+        images = GetImages(images_filename, &image_count, &row_count, &col_count);
+        if (images == NULL) {
+            fprintf(stderr, "Failed to retrieve images from file \"%s\".\n", images_filename);
+            return 1;
+        }
+    } else {
+        size_t input_size;
+        if (GetServerInputSize(address, &input_size)) {
+            fprintf(stderr, "Failed to read the input size from the server at \"%s\".\n", address);
+            return 1;
+        }
+        col_count = (uint32_t)input_size;
+        // same layout as `GetImages()`, so it can be freed the same way
+        images = malloc(image_count * sizeof(char*));
+        char *rawdata = malloc((size_t)image_count * row_count * col_count);
+        if (images == NULL || rawdata == NULL) {
+            free(rawdata);
+            free(images);
+            fprintf(stderr, "Failed to allocate memory on the heap for images.\n");
+            return 1;
+        }
+        srand((unsigned int)time(NULL));
+        for (size_t i = 0; i < (size_t)image_count * row_count * col_count; i++) rawdata[i] = (char)(rand() & UCHAR_MAX);
+        for (size_t i = 0; i < image_count; i++) images[i] = rawdata + (i * (row_count * col_count));
+    }
+    if (labels_filename != NULL) {
+        uint32_t label_count;
+        labels = GetLabels(labels_filename, &label_count);
+        if (labels == NULL || label_count < image_count) {
+            fprintf(stderr, "Failed to retrieve labels from file \"%s\".\n", labels_filename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+    if (image_count == 0) {
+        fprintf(stderr, "No images to send.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    struct sigaction action = { 0 };
+    action.sa_handler = SIG_IGN;
+    (void)sigaction(SIGPIPE, &action, NULL); // the server closing a connection fails it rather than killing the process
+    clients = calloc(connections, sizeof(ClientArgs));
+    threads = malloc(connections * sizeof(pthread_t));
+    if (clients == NULL || threads == NULL || InitLatencyStats(&total, LATENCY_SAMPLES_CAPACITY)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for connections.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    double start = GetMonotonicTime();
+    size_t started = 0;
+    for (; started < connections; started++) {
+        ClientArgs *client = &clients[started];
+        client->address = address;
+        client->index = started;
+        client->connections = connections;
+        client->deadline = start + duration;
+        client->images = images;
+        client->image_count = image_count;
+        client->input_size = (size_t)row_count * col_count;
+        client->labels = labels;
+        if (InitLatencyStats(&client->stats, LATENCY_SAMPLES_CAPACITY / connections + 1) || pthread_create(&threads[started], NULL, ClientThread, client) != 0) {
+            FreeLatencyStats(&client->stats);
+            fprintf(stderr, "Failed to start connection %zu.\n", started + 1);
+            returnValue = 1;
+            break;
+        }
+    }
+    size_t failed = 0;
+    size_t right = 0;
+    for (size_t i = 0; i < started; i++) {
+        (void)pthread_join(threads[i], NULL);
+        if (clients[i].failed) failed++;
+        right += clients[i].right;
+        MergeLatencyStats(&total, &clients[i].stats);
+        FreeLatencyStats(&clients[i].stats);
+    }
+    double elapsed = GetMonotonicTime() - start;
+
+    printf("Connections: %zu (%zu failed)\n", started, failed);
+    PrintLatencyStats(stdout, "", &total, elapsed);
+    if (labels != NULL && total.total > 0) printf("Accuracy: %.4f\n", (double)right / total.total);
+    if (failed > 0 || total.total == 0) returnValue = 1;
+
+    CleanupLabel:
+
+    FreeLatencyStats(&total);
+    free(threads);
+    free(clients);
+    free(labels);
+    if (images != NULL) free(images[0]);
+    free(images);
+    return returnValue;
+}
\ No newline at end of file
@@ -1,52 +1,5 @@
 #include "main.h"
 
-// Performs a forward pass on the network
-void ForwardPass(size_t inputLayerSize, double *inputLayer, size_t layers_count, size_t *layer_lengths, double **weights, double **biases,
-    double **deactivated_neurons, double **activated_neurons) {
-    // case for `layer == 0` is considered manually because it maps to `inputLayer` which is special
-    size_t layer = 0;
-    TransformVector(inputLayerSize, layer_lengths[layer], weights[layer], inputLayer, deactivated_neurons[layer]);
-    AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
-    ActivateVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
-    layer++;
-    while (layer < layers_count - 1) {
-        TransformVector(layer_lengths[layer - 1], layer_lengths[layer], weights[layer], activated_neurons[layer - 1], deactivated_neurons[layer]);
-        AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
-        ActivateVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
-        layer++;
-    }
-    // case for `layer == layers_count - 1` is considered manually because it uses a different activation function
-    TransformVector(layer_lengths[layer - 1], layer_lengths[layer], weights[layer], activated_neurons[layer - 1], deactivated_neurons[layer]);
-    AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
-    ActivateOutputVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
-}
-
-// Propagates backwards through the network and acquires jacobians; does not perform gradient descent
-// `intended` is the ideal output that the network is training to achieve
-void BackPropagate(size_t layers_count, size_t *layer_lengths, double **weights, double **deactivated_neurons, double **activated_neurons, double *intended, double **biasJacobian) {
-
-    // NOTE: jacobians are ALL with respect to cost
-    //       `biasJacobian` used as derivative of deactivated neurons with respect to cost
-    //       `biasJacobian` of `layer - 1` used as derivative of activated neurons with respect to cost
-
-    size_t layer = layers_count - 1;
-    CostPrimeWrtDeactivated(layer_lengths[layer], biasJacobian[layer], activated_neurons[layer], intended);
-    while (layer-- > 0) {
-        // Compute activation derivative once for the layer
-        ActivationPrime(layer_lengths[layer], biasJacobian[layer], deactivated_neurons[layer]);
-
-        for (size_t row = 0; row < layer_lengths[layer]; row++) {
-            double sum = 0.0;
-            for (size_t i = 0; i < layer_lengths[layer + 1]; i++) {
-                // Weighted sum of next-layer errors
-                sum += biasJacobian[layer + 1][i] * weights[layer + 1][(i * layer_lengths[layer]) + row];
-            }
-            // Apply chain rule
-            biasJacobian[layer][row] *= sum;
-        }
-    }
-}
-
 int main() {
     int returnValue = 0;
 
@@ -54,31 +7,33 @@ int main() {
     char training_labels_filename[MAX_PATH] = { 0 };
     char testing_images_filename[MAX_PATH] = { 0 };
     char testing_labels_filename[MAX_PATH] = { 0 };
+    char tuningCache[MAX_PATH] = { 0 }; // auto-tuning cache file; empty to not tune
     // declared here to allow `goto Cleanup;`
     char **images = NULL;
     char *labels = NULL;
     char **test_images = NULL;
     char *test_labels = NULL;
     size_t *layer_lengths = NULL;
-    double *inputLayer = NULL;
-    double **activated_neurons = NULL;
-    double **deactivated_neurons = NULL;
-    double *all_deactivated_neurons = NULL;
-    double *all_activated_neurons = NULL;
-    double **weights = NULL; // each element is a row-major weight matrix; col is source neuron, row is dest neuron
-    double *all_weights = NULL;
-    double **biases = NULL;
-    double *all_biases = NULL;
-    double *intendedOutput = NULL;
-    double **biasJacobians = NULL;
-    double *all_biases_j = NULL;
+    ConvLayer *conv_layers = NULL; // conv/pool layers from the config file, ahead of the dense layers
+    Network network = { 0 }; // weights and biases
+    TrainingScratch trainingScratch = { 0 }; // neurons and jacobians for training
+    NetworkScratch testingScratch = { 0 }; // neurons for testing
+    ParallelTrainer parallelTrainer = { 0 }; // stages for pipelined training
 
     bool layers_count_set = false;
     size_t layers_count = 0;
+    size_t conv_count = 0;
     bool learningRate_set = false;
     double learningRate = 0.0;
     bool learningRateMultiplier_set = false;
     double learningRateMultiplier = 0.0; // multiplier to learning rate between epochs
+    double targetSparsity = 0.0; // fraction of weights to prune; 0 disables pruning
+    size_t pruningEpochs = DEFAULT_PRUNING_EPOCHS; // epochs over which `targetSparsity` is reached
+    size_t batchSize = 1; // training samples per step of gradient descent
+    size_t checkpointInterval = 0; // see `NetworkScratch`; 0 keeps every layer's neurons
+    size_t pipelineStages = 0; // threads to pipeline training across (see `pipeline.c`); 0 or 1 trains on this thread
+    size_t microBatches = 0; // per batch when pipelined; 0 for 4 per stage
+    size_t bf16Weights = 0; // nonzero to run on bfloat16 weights, keeping fp64 ones as the master copy
 
     GetConfigContext configContext = { 0 };
     configContext.learningRate_set = &learningRate_set; // `true` if `learningRate` has been modified already
@@ -88,20 +43,50 @@ int main() {
     configContext.layersCount_set = &layers_count_set; // `true` if `layers_count` has been modified already
     configContext.layersCount = &layers_count;
     configContext.layerLengths = &layer_lengths;
+    configContext.convLayersCount = &conv_count;
+    configContext.convLayers = &conv_layers;
     configContext.training_images_filename = training_images_filename;
     configContext.training_labels_filename = training_labels_filename;
     configContext.testing_images_filename = testing_images_filename;
     configContext.testing_labels_filename = testing_labels_filename;
+    configContext.targetSparsity = &targetSparsity;
+    configContext.pruningEpochs = &pruningEpochs;
+    configContext.batchSize = &batchSize;
+    configContext.checkpointInterval = &checkpointInterval;
+    configContext.tuningCache = tuningCache;
+    configContext.pipelineStages = &pipelineStages;
+    configContext.microBatches = &microBatches;
+    configContext.bf16Weights = &bf16Weights;
     if (GetConfig(CONFIG_FILENAME, &configContext)) {
         fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
         returnValue = 1;
         goto CleanupLabel;
     }
-    if (layers_count_set && layers_count < 2) {
+    if (layers_count_set && layers_count + conv_count < 2) {
         fprintf(stderr, "Invalid number of layers from config file \"%s\".\n", CONFIG_FILENAME);
         returnValue = 1;
         goto CleanupLabel;
     }
+    if (targetSparsity >= 1.0) {
+        fprintf(stderr, "Invalid target sparsity from config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (batchSize == 0) {
+        fprintf(stderr, "Invalid batch size from config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (bf16Weights && targetSparsity > 0.0) {
+        fprintf(stderr, "bfloat16 weights from config file \"%s\" can't be used with a target sparsity, as pruned networks are saved sparse in fp64.\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (pipelineStages > 1 && (conv_count > 0 || checkpointInterval > 0)) {
+        fprintf(stderr, "Pipelined training from config file \"%s\" can't be used with conv/pool layers or a checkpoint interval.\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
 
     /* RETRIEVE TRAINING DATA */
 
@@ -293,98 +278,107 @@ int main() {
         }
     }
 
-    inputLayer = malloc(row_count * col_count * sizeof(double));
-    if (inputLayer == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for input layer.\n");
+    if (GetConvShapes(row_count, col_count, conv_count, conv_layers)) {
+        fprintf(stderr, "Convolution and pooling layers from config file \"%s\" don't fit %u x %u images.\n", CONFIG_FILENAME, col_count, row_count);
         returnValue = 1;
         goto CleanupLabel;
     }
-
-    // The below is all done to for contiguity and cache locality
-    activated_neurons = malloc(layers_count * sizeof(double*));
-    deactivated_neurons = malloc(layers_count * sizeof(double*));
-    size_t total_neuron_count = 0;
-    for (size_t i = 0; i < layers_count; i++) {
-        total_neuron_count += layer_lengths[i];
-    }
-    all_activated_neurons = malloc(total_neuron_count * sizeof(double));
-    all_deactivated_neurons = malloc(total_neuron_count * sizeof(double));
-    if (activated_neurons == NULL || deactivated_neurons == NULL || all_activated_neurons == NULL || all_deactivated_neurons == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+    if (AllocConvNetwork(&network, row_count, col_count, conv_count, conv_layers, layers_count, layer_lengths)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for weights and biases.\n");
         returnValue = 1;
         goto CleanupLabel;
     }
-    size_t offset = 0;
-    for (size_t i = 0; i < layers_count; i++) {
-        activated_neurons[i] = &all_activated_neurons[offset];
-        deactivated_neurons[i] = &all_deactivated_neurons[offset];
-        offset += layer_lengths[i];
-    }
 
-    weights = malloc(layers_count * sizeof(double*));
-    size_t total_weight_count = 0;
-    total_weight_count += (row_count * col_count) * layer_lengths[0];
-    for (size_t i = 1; i < layers_count; i++) total_weight_count += layer_lengths[i - 1] * layer_lengths[i];
-    all_weights = malloc(total_weight_count * sizeof(double));
-    if (weights == NULL || all_weights == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for weights.\n");
+    // Initialise weights to random (He initialisation) and biases to 0
+    srand((unsigned int)time(NULL));
+    InitialiseNetwork(&network);
+    if (bf16Weights && BuildBf16Weights(&network)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for bfloat16 weights.\n");
         returnValue = 1;
         goto CleanupLabel;
     }
-    offset = 0;
-    // case for `i == 0` is considered manually because it maps to `inputLayer` which is special
-    weights[0] = &all_weights[offset];
-    offset += (row_count * col_count) * layer_lengths[0];
-    for (size_t i = 1; i < layers_count; i++) {
-        weights[i] = &all_weights[offset];
-        offset += layer_lengths[i - 1] * layer_lengths[i];
-    }
 
-    biases = malloc(layers_count * sizeof(double*));
-    all_biases = malloc(total_neuron_count * sizeof(double));
-    if (biases == NULL || all_biases == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for biases.\n");
+    Tuning tuning;
+    DefaultTuning(&tuning);
+    if (tuningCache[0] != '\0') {
+        if (LoadTuning(tuningCache, &network, batchSize, &tuning) == 0) {
+            printf("Loaded tuning for this host from \"%s\".\n", tuningCache);
+        } else {
+            printf("Tuning for this host...\n");
+            double start = GetMonotonicTime();
+            if (TuneNetwork(&network, batchSize, &tuning)) {
+                fprintf(stderr, "Failed to allocate memory on the heap for tuning.\n");
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+            printf("Tuned in %.0fms.\n", (GetMonotonicTime() - start) * 1000.0);
+            // the tuning still applies to this run
+            if (SaveTuning(tuningCache, &network, batchSize, &tuning)) fprintf(stderr, "Failed to save tuning to \"%s\".\n", tuningCache);
+        }
+        printf("Tiles: forward %zu, backward %zu, update %zu; testing batch size: %zu; threads: %zu\n",
+            tuning.tiles.forward, tuning.tiles.backward, tuning.tiles.update, tuning.testing_batch, tuning.threads);
+    }
+    if (AllocTrainingScratch(&trainingScratch, &network, batchSize, checkpointInterval) || AllocScratch(&testingScratch, &network, tuning.testing_batch)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
         returnValue = 1;
         goto CleanupLabel;
     }
-    offset = 0;
-    for (size_t i = 0; i < layers_count; i++) {
-        biases[i] = &all_biases[offset];
-        offset += layer_lengths[i];
-    }
-
-    intendedOutput = malloc(layer_lengths[layers_count - 1] * sizeof(double));
-    if (intendedOutput == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for vectorised labels.\n");
+    trainingScratch.forward.tiles = tuning.tiles;
+    testingScratch.tiles = tuning.tiles;
+    if (pipelineStages > network.layers_count) {
+        fprintf(stderr, "More pipeline stages from config file \"%s\" than dense layers.\n", CONFIG_FILENAME);
         returnValue = 1;
         goto CleanupLabel;
     }
-
-    // Get persistent space for jacobians
-    biasJacobians = malloc(layers_count * sizeof(double*));
-    all_biases_j = malloc(total_neuron_count * sizeof(double));
-    if (biasJacobians == NULL || all_biases_j == NULL) {
-        fprintf(stderr, "Failed to allocate memory on the heap for bias jacobian.\n");
+    if (pipelineStages > 1) {
+        if (AllocParallelTrainer(&parallelTrainer, &network, PIPELINE_PARALLEL, pipelineStages, batchSize, microBatches > 0 ? microBatches : 4 * pipelineStages)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for pipeline stages.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        parallelTrainer.tiles = tuning.tiles;
+    }
+    if (tuning.threads > 1 && (trainingScratch.forward.pool = CreateWorkPool(tuning.threads)) == NULL) {
+        fprintf(stderr, "Failed to start a pool of %zu threads.\n", tuning.threads);
         returnValue = 1;
         goto CleanupLabel;
     }
-    offset = 0;
-    for (size_t i = 0; i < layers_count; i++) {
-        biasJacobians[i] = all_biases_j + offset;
-        offset += layer_lengths[i];
+
+    if (targetSparsity > 0.0) {
+        // nothing is pruned yet, as no weight is exactly 0
+        if (AllocMasks(&network)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for pruning masks.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        printf("Pruning to %.2f%% sparsity over %zu epochs.\n", targetSparsity * 100.0, pruningEpochs);
     }
 
-    // Initialise weights to random (He initialisation)
-    srand((unsigned int)time(NULL));
-    //memset(weights[0], 0, row_count * col_count * layer_lengths[0] * sizeof(double));
-    for (size_t j = 0; j < row_count * col_count * layer_lengths[0]; j++) weights[0][j] = sqrt(2.0 / (row_count * col_count)) * ((double)rand() / (double)RAND_MAX - 0.5);
-    for (size_t i = 1; i < layers_count; i++) {
-        //memset(weights[i], 0, layer_lengths[i - 1] * layer_lengths[i] * sizeof(double));
-        for (size_t j = 0; j < layer_lengths[i - 1] * layer_lengths[i]; j++) weights[i][j] = sqrt(2.0 / layer_lengths[i - 1]) * ((double)rand() / (double)RAND_MAX - 0.5);
+    for (size_t i = 0; i < network.conv_count; i++) {
+        const ConvLayer *layer = &network.conv_layers[i];
+        const char *name = layer->type == CONV_LAYER ? "Convolution" : layer->type == MAX_POOL_LAYER ? "Max pooling" : "Average pooling";
+        printf("%s %zux%zu, stride %zu: %zu x %zu x %zu -> %zu x %zu x %zu\n", name, layer->kernel, layer->kernel, layer->stride,
+            layer->in_width, layer->in_height, layer->in_channels, layer->out_width, layer->out_height, layer->out_channels);
+    }
+    printf("Parameters: %zu, multiply-adds per image: %zu\n", network.total_conv_param_count + network.total_weight_count + network.total_neuron_count, CountMultiplyAdds(&network));
+    if (batchSize > 1 || checkpointInterval > 0) {
+        printf("Batch size: %zu, checkpoint interval: %zu\n", batchSize, checkpointInterval);
+    }
+    if (bf16Weights) {
+        printf("Weights: bfloat16 (%.2f MiB), with an fp64 master copy (%.2f MiB)\n", (double)(network.total_weight_count * sizeof(uint16_t)) / (1024.0 * 1024.0),
+            (double)(network.total_weight_count * sizeof(double)) / (1024.0 * 1024.0));
     }
-    // Initialise biases to 0
-    for (size_t i = 0; i < layers_count; i++) {
-        memset(biases[i], 0, layer_lengths[i] * sizeof(double));
+    if (pipelineStages > 1) {
+        printf("Pipeline stages: %zu, micro-batch size: %zu; layers per stage:", pipelineStages, parallelTrainer.micro_batch);
+        for (size_t stage = 0; stage < pipelineStages; stage++) {
+            size_t first, last;
+            GetStageLayers(&parallelTrainer, stage, &first, &last);
+            printf(" %zu", last - first);
+        }
+        putchar('\n');
+        printf("Training memory: %.2f MiB\n", (double)parallelTrainer.bytes / (1024.0 * 1024.0));
+    } else {
+        printf("Training memory: %.2f MiB\n", (double)trainingScratch.bytes / (1024.0 * 1024.0));
     }
 
     printf("Initialisation complete.\n");
@@ -396,49 +390,39 @@ int main() {
 
 
     size_t trainingCount = image_count < label_count ? image_count : label_count;
+    size_t testingCount = test_image_count < test_label_count ? test_image_count : test_label_count;
     for (size_t epoch = 1; epoch < SIZE_MAX; epoch++, learningRate *= learningRateMultiplier) {
         printf("Epoch %zu:\n", epoch);
         clock_t clockStart = clock();
-        for (size_t image = 0; image < trainingCount; image++) {
-            for (size_t i = 0; i < row_count * col_count; i++) inputLayer[i] = (double)(unsigned char)images[image][i] / UCHAR_MAX; // set input layer
-            ForwardPass(row_count * col_count, inputLayer, layers_count, (size_t*)layer_lengths, weights, biases, deactivated_neurons, activated_neurons);
-
-            (void)memset(intendedOutput, 0, layer_lengths[layers_count - 1] * sizeof(double));
-            intendedOutput[(unsigned char)labels[image]] = 1.0;
-            //double cost = Cost(layer_lengths[layers_count - 1], activated_neurons[layers_count - 1], intendedOutput); // unnecessary
-
-            BackPropagate(layers_count, (size_t*)layer_lengths, weights, deactivated_neurons, activated_neurons, intendedOutput, biasJacobians);
-            Descend(layers_count, (size_t*)layer_lengths, row_count * col_count, inputLayer, activated_neurons, weights, biases, biasJacobians, learningRate);
+        if (pipelineStages < 2) {
+            TrainEpoch(&network, &trainingScratch, trainingCount, images, labels, learningRate);
+        } else if (TrainEpochParallel(&network, &parallelTrainer, trainingCount, images, labels, learningRate)) {
+            fprintf(stderr, "Failed to start %zu pipeline stage threads.\n", pipelineStages);
+            returnValue = 1;
+            goto CleanupLabel;
         }
         clock_t clockEnd = clock();
         double elapsed_ms = (double)(clockEnd - clockStart) * 1000.0 / CLOCKS_PER_SEC;
         printf("\tTraining time: %fms.\n", elapsed_ms);
 
+        /* PRUNING */
+
+        if (targetSparsity > 0.0) {
+            PruneNetwork(&network, PruningSchedule(targetSparsity, epoch, pruningEpochs));
+            printf("\tSparsity: %.2f%% (%zu bytes saved sparse, %zu dense)\n", GetSparsity(&network) * 100.0,
+                GetNetworkFileSize(&network, true), GetNetworkFileSize(&network, false));
+        }
+
         /* TESTING */
 
-        size_t numRight = 0;
         double totalCost = 0.0;
         clockStart = clock();
-        for (size_t image = 0; image < test_image_count; image++) {
-            for (size_t i = 0; i < row_count * col_count; i++) inputLayer[i] = (double)(unsigned char)test_images[image][i] / UCHAR_MAX; // set input layer
-            ForwardPass(row_count * col_count, inputLayer, layers_count, (size_t*)layer_lengths, weights, biases, deactivated_neurons, activated_neurons);
-            
-            size_t largestindex = 0;
-            for (size_t i = 0; i < layer_lengths[layers_count - 1]; i++) {
-                if (activated_neurons[layers_count - 1][i] > activated_neurons[layers_count - 1][largestindex]) largestindex = i;
-            }
-            memset(intendedOutput, 0, layer_lengths[layers_count - 1] * sizeof(double));
-            intendedOutput[(unsigned char)test_labels[image]] = 1.0;
-            totalCost += Cost(layer_lengths[layers_count - 1], activated_neurons[layers_count - 1], intendedOutput);
-            if ((size_t)test_labels[image] == largestindex) {
-                numRight++;
-            }
-        }
+        size_t numRight = Evaluate(&network, &testingScratch, testingCount, test_images, test_labels, &totalCost);
         clockEnd = clock();
         elapsed_ms = (double)(clockEnd - clockStart) * 1000.0 / CLOCKS_PER_SEC;
         printf("\tTesting time: %.0fms.\n", elapsed_ms);
-        printf("\tAccuracy: %.4f\n", (double)numRight / test_image_count);
-        printf("\tAvg cost: %.4f\n", totalCost / test_image_count);
+        printf("\tAccuracy: %.4f\n", (double)numRight / testingCount);
+        printf("\tAvg cost: %.4f\n", totalCost / testingCount);
 
         CheckSaveLabel:
         printf("\tEnter a filename to save this network to disk (.nn extension recommended): ");
@@ -454,37 +438,15 @@ int main() {
             }
             saveFilename[index] = '\0';
             if (saveFilename[0] != '\0') {
-                FILE *savefile = fopen(saveFilename, "wb");
-                if (savefile == NULL) {
-                    printf("\tThere was an error opening the file \"%s\".\n", saveFilename);
-                    goto CheckSaveLabel;
-                }
-                uint16_t endianness = 1;
-                uint64_t double_size = (uint64_t)sizeof(double); // the furthest i was willing to go to conform to the C standard
-                uint64_t inputSize = (uint64_t)(row_count * col_count);
-                uint64_t layers_count_64 = (uint64_t)layers_count;
-                uint64_t *layer_lengths_64 = malloc(layers_count_64 * sizeof(uint64_t));
-                if (layer_lengths_64 == NULL) {
-                    printf("\tThere was an error allocating memory while saving to file \"%s\".\n", saveFilename);
+                // pruned networks are saved sparse (and can't have bfloat16 weights)
+                int failed = targetSparsity > 0.0 ? SaveSparseNetwork(saveFilename, &network)
+                    : bf16Weights ? SaveBf16Network(saveFilename, &network)
+                    : SaveNetwork(saveFilename, &network);
+                if (failed) {
+                    printf("\tFailed to finish writing to the file \"%s\".\n", saveFilename);
                     goto CheckSaveLabel;
                 }
-                if (fwrite(&endianness, sizeof(uint16_t), 1, savefile) != 1) goto fWriteError;
-                if (fwrite(&inputSize, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
-                if (fwrite(&layers_count_64, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError;
-                if (fwrite(layer_lengths_64, sizeof(uint64_t), layers_count_64, savefile) != layers_count_64) goto fWriteError;
-                if (fwrite(&double_size, sizeof(uint64_t), 1, savefile) != 1) goto fWriteError; // records `sizeof(double)` for correct interpretation during loading
-                if (fwrite(all_weights, sizeof(double), total_weight_count, savefile) != total_weight_count) goto fWriteError;
-                if (fwrite(all_biases, sizeof(double), total_neuron_count, savefile) != total_neuron_count) goto fWriteError;
-                goto SkipFWriteError;
-                fWriteError:
-                printf("\tFailed to finish writing to the file \"%s\".\n", saveFilename);
-                free(layer_lengths_64);
-                fclose(savefile);
-                goto CheckSaveLabel;
-                SkipFWriteError:
                 printf("\tSuccessfully written to the file \"%s\".\n", saveFilename);
-                free(layer_lengths_64);
-                fclose(savefile);
             }
         }
     }
@@ -497,19 +459,18 @@ int main() {
     getchar();
     printf("Terminating...\n");
 
-    free(all_biases_j);
-    free(intendedOutput);
-    free(all_biases);
-    free(all_weights);
-    free(all_activated_neurons);
-    free(all_deactivated_neurons);
-    free(inputLayer);
+    FreeParallelTrainer(&parallelTrainer);
+    FreeScratch(&testingScratch);
+    DestroyWorkPool(trainingScratch.forward.pool);
+    FreeTrainingScratch(&trainingScratch);
+    FreeNetwork(&network);
     free(test_labels);
     if (test_images != NULL) free(test_images[0]);
     free(test_images);
     free(labels);
     if (images != NULL) free(images[0]);
     free(images);
+    free(conv_layers);
     free(layer_lengths);
     return returnValue;
 }
\ No newline at end of file
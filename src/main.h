@@ -17,12 +17,21 @@
     #include <math.h>
     #include <time.h>
     #include "config_context.h" // contains `MAX_PATH`
+    #include "network.h"
+    #include "stats.h"
+    #include "threadpool.h"
 
     #define CONFIG_FILENAME "config.cfg" // contains everything that would be manually input, or doesn't
+    #define TESTING_BATCH_SIZE 64 // images per forward pass while testing
+    #define DEFAULT_PRUNING_EPOCHS 5 // used if the config file gives a target sparsity but no pruning epochs
 
 
     /* `readData.c` */
 
+    // Opens an IDX3 image file for streaming, positioned at the first image; returns NULL on failure
+    // Each image is then `row_count * col_count` bytes; close with `fclose()`
+    extern FILE *OpenImages(const char *filename, uint32_t *image_count, uint32_t *row_count, uint32_t *col_count);
+
     // Where `char **results = GetImages();`, only free `results[0]` and `results`, if and only if function returns non-NULL
     // Result is an array of images
     extern char **GetImages(const char *filename, uint32_t *image_count, uint32_t *row_count, uint32_t *col_count);
@@ -38,6 +47,34 @@
     //       assumes fields in `context` are set to `0` or `NULL` or `'\0'` already
     int GetConfig(const char *config_filename, GetConfigContext *context);
 
+    // Returns 0 on success, 1 on failure
+    // Reads the dataset filenames (each `MAX_PATH` long) from `config_filename` for the tools that share `cnn`'s config file, and
+    // its learning rate into `learningRate` unless that's already positive (e.g. given on the command line)
+    // `context` may be NULL, or point to any other fields to read like `GetConfig()`, such as the layers, which the caller frees
+    extern int GetDatasetConfig(const char *config_filename, char *training_images_filename, char *training_labels_filename,
+        char *testing_images_filename, char *testing_labels_filename, double *learningRate, GetConfigContext *context);
+
+    // Returns 0 on success, 1 on failure
+    // Writes `net` in the dense `.nn` format
+    extern int SaveNetwork(const char *filename, const Network *net);
+
+    // Returns 0 on success, 1 on failure
+    // Writes `net` in the sparse `.nn` format, storing only nonzero weights
+    extern int SaveSparseNetwork(const char *filename, const Network *net);
+
+    // Returns 0 on success, 1 on failure
+    // Writes `net` in the bfloat16 `.nn` format, storing each weight rounded to bfloat16 (a quarter of the size of `SaveNetwork()`'s)
+    extern int SaveBf16Network(const char *filename, const Network *net);
+
+    // Returns the size in bytes of `net` saved by `SaveSparseNetwork()` if `sparse`, otherwise by `SaveNetwork()`
+    extern size_t GetNetworkFileSize(const Network *net, bool sparse);
+
+    // Returns 0 on success, 1 on failure
+    // Reads any `.nn` format; networks saved sparse also get `net->sparse_weights` built, so they run with the sparse kernels,
+    // and networks saved as bfloat16 get `net->bf16_weights` built (holding exactly the saved weights), so they run with the bfloat16 kernels
+    // `net` is allocated by this function and must be freed with `FreeNetwork()` if and only if this function succeeds
+    extern int LoadNetwork(const char *filename, Network *net);
+
     /* `helpers.c` */
 
     // returns a double to the power of a long
@@ -86,9 +123,334 @@
     // `matrix` should be row-major
     extern void TransformVector(size_t width, size_t height, double *matrix, double *invector, double *outvector);
 
+    // `outvector = (matrix)^T(invector)`
+    // `matrix` should be row-major; `invector` is `height` long and `outvector` is `width` long
+    extern void TransformVectorTransposed(size_t width, size_t height, double *matrix, double *invector, double *outvector);
+
+    // `outmatrix = (matrix)(inmatrix)` for each of `batch` samples
+    // `matrix` should be row-major; `inmatrix` holds one `width` long sample per row and `outmatrix` one `height` long result per row
+    // `tile` columns of `matrix` are done at a time (0 does whole rows); the result doesn't depend on it
+    extern void TransformBatch(size_t width, size_t height, size_t batch, double *matrix, double *inmatrix, double *outmatrix, size_t tile);
+
+    // `outmatrix = (matrix)(inmatrix)` for each of `batch` samples, with a sparse `matrix`
+    // `inmatrix` holds one `matrix->cols` long sample per row and `outmatrix` one `matrix->rows` long result per row
+    extern void SparseTransformBatch(const CsrMatrix *matrix, size_t batch, double *inmatrix, double *outmatrix);
+
+    // `outmatrix = (matrix)^T(inmatrix)` for each of `batch` samples
+    // `inmatrix` holds one `height` long sample per row and `outmatrix` one `width` long result per row
+    // `tile` rows of `matrix` are done at a time for every sample (0 does the whole matrix per sample); the result doesn't depend on it
+    extern void TransformBatchTransposed(size_t width, size_t height, size_t batch, double *matrix, double *inmatrix, double *outmatrix, size_t tile);
+
     // Performs gradient descent
+    // `masks` may be NULL; otherwise weights with a mask of 0 are left untouched
     extern void Descend(size_t layers_count, size_t *layer_lengths, size_t inputSize, double *inputLayer, double **activated_neurons, double **weights, double **biases, 
-        double **biasesJacobian, double learningRate);
+        double **biasesJacobian, double learningRate, unsigned char **masks);
+
+    // Performs gradient descent on one layer with the summed gradient of `batch` samples
+    // `inputs` holds one `width` long sample of the layer's input per row, and `biasesJacobian` one `height` long sample per row
+    // `mask` may be NULL; otherwise weights with a mask of 0 are left untouched
+    // `tile` columns are done at a time (0 does whole rows); the result doesn't depend on it
+    extern void DescendBatch(size_t width, size_t height, size_t batch, double *inputs, double *weights, double *biases, double *biasesJacobian, double learningRate, unsigned char *mask,
+        size_t tile);
+
+    /* `network.c` */
+
+    // Performs a forward pass on the network
+    extern void ForwardPass(size_t inputLayerSize, double *inputLayer, size_t layers_count, size_t *layer_lengths, double **weights, double **biases,
+        double **deactivated_neurons, double **activated_neurons);
+
+    // Propagates backwards through the network and acquires jacobians; does not perform gradient descent
+    // `intended` is the ideal output that the network is training to achieve
+    extern void BackPropagate(size_t layers_count, size_t *layer_lengths, double **weights, double **deactivated_neurons, double **activated_neurons, double *intended, double **biasJacobian);
+
+    // Returns 0 on success, 1 on failure
+    // Weights and biases are left uninitialised; `layer_lengths` is copied
+    extern int AllocNetwork(Network *net, size_t input_size, size_t layers_count, const size_t *layer_lengths);
+
+    // Returns 0 on success, 1 on failure (including conv/pool layers that don't fit the images, or sizes that overflow `size_t`)
+    // Like `AllocNetwork()`, with `conv_count` conv/pool layers ahead of the dense layers, for `input_rows * input_cols` images
+    // `conv_layers` is copied, with shapes filled in by `GetConvShapes()`; it may be NULL if `conv_count` is 0
+    extern int AllocConvNetwork(Network *net, size_t input_rows, size_t input_cols, size_t conv_count, const ConvLayer *conv_layers,
+        size_t layers_count, const size_t *layer_lengths);
+
+    // Safe to call on a zeroed or partially allocated `Network`
+    extern void FreeNetwork(Network *net);
+
+    // Initialises weights to random (He initialisation) and biases to 0
+    // Uses `rand()`, so seed with `srand()` beforehand
+    extern void InitialiseNetwork(Network *net);
+
+    // Returns 0 on success, 1 on failure
+    extern int AllocScratch(NetworkScratch *scratch, const Network *net, size_t batch_capacity);
+
+    // Returns the number of neurons per sample that a scratch with `checkpoint_interval` stores (both deactivated and activated)
+    extern size_t GetScratchNeuronCount(const Network *net, size_t checkpoint_interval);
+
+    // Returns 0 on success, 1 on failure
+    // Like `AllocScratch()`, but with `checkpoint_interval` (see `NetworkScratch`); such a scratch is only for `TrainEpoch()`
+    extern int AllocCheckpointedScratch(NetworkScratch *scratch, const Network *net, size_t batch_capacity, size_t checkpoint_interval);
+
+    // Safe to call on a zeroed or partially allocated `NetworkScratch`
+    extern void FreeScratch(NetworkScratch *scratch);
+
+    // Converts `count` raw images into rows of `inputs`, scaled to [0, 1]
+    extern void LoadInputs(size_t count, size_t input_size, char **images, double *inputs);
+
+    // Performs a forward pass on `batch` samples at once
+    // `inputs` holds one sample per row (`batch * net->input_size`); `batch` must not exceed `scratch->batch_capacity`
+    // The outputs of sample `b` are at `&scratch->activated_neurons[net->layers_count - 1][b * output length]`
+    extern void ForwardPassBatch(const Network *net, size_t batch, double *inputs, NetworkScratch *scratch);
+
+    // Returns the number of multiply-adds in the convolutions and dense layers of one forward pass of one sample
+    extern size_t CountMultiplyAdds(const Network *net);
+
+    // Returns the index of the largest element (the predicted class for an output layer)
+    extern size_t ArgMax(size_t len, const double *vector);
+
+    // Returns 0 on success, 1 on failure
+    // `batch_capacity` of 1 with no `checkpoint_interval` trains one sample at a time with `BackPropagate()` and `Descend()`;
+    // anything else trains in batches, which also supports checkpointing (see `NetworkScratch`)
+    extern int AllocTrainingScratch(TrainingScratch *scratch, const Network *net, size_t batch_capacity, size_t checkpoint_interval);
+
+    // Safe to call on a zeroed or partially allocated `TrainingScratch`
+    extern void FreeTrainingScratch(TrainingScratch *scratch);
+
+    // Trains `net` on `count` images with stochastic gradient descent, `scratch->forward.batch_capacity` samples at a time
+    // Pruned weights (see `Network.masks`) stay pruned
+    // With `net->bf16_weights`, batches run on them and step the fp64 weights (mixed precision); one sample at a time runs on the
+    // fp64 weights, which are rounded into the bfloat16 ones at the end
+    extern void TrainEpoch(Network *net, TrainingScratch *scratch, size_t count, char **images, char *labels, double learningRate);
+
+    // Returns the number of `count` images that `net` classifies correctly, running them `scratch->batch_capacity` at a time
+    // If `totalCost` isn't NULL, it's set to the sum of `Cost()` over every image
+    extern size_t Evaluate(const Network *net, NetworkScratch *scratch, size_t count, char **images, char *labels, double *totalCost);
+
+    // Returns the fastest of `runs` timed passes of `Evaluate()` over `count` images, in seconds
+    extern double TimeInference(const Network *net, NetworkScratch *scratch, size_t count, char **images, char *labels, size_t runs);
+
+    /* `conv.c` */
+
+    // Number of values in one sample of the layer's output
+    extern size_t ConvOutputSize(const ConvLayer *layer);
+
+    // Returns 0 on success, 1 if a layer is invalid or doesn't fit its input
+    // Fills in the input and output shapes of each of `conv_layers`, given single-channel `input_rows * input_cols` images
+    extern int GetConvShapes(size_t input_rows, size_t input_cols, size_t conv_count, ConvLayer *conv_layers);
+
+    // Runs the conv/pool layers on `batch` samples at once
+    // `inputs` holds one sample per row; the dense layers' input for sample `b` is then at `&scratch->conv_outputs[net->conv_count - 1][b * net->dense_input_size]`
+    extern void ConvForwardBatch(const Network *net, size_t batch, double *inputs, NetworkScratch *scratch);
+
+    // Backpropagates through the conv/pool layers of one sample, adding the derivative of cost with respect to the convolutions'
+    // parameters to `scratch->conv_gradients`; `DescendConvLayers()` then steps them, so every sample of a batch sees the same filters
+    // Call before the first dense layer's weights are updated
+    // `input` is the sample's input layer, and `scratch->forward` must hold the forward pass of its batch, where it is number `sample`
+    // `denseJacobian` is the derivative of cost with respect to the sample's deactivated first dense layer
+    extern void BackPropagateConvLayers(const Network *net, TrainingScratch *scratch, size_t sample, double *input, double *denseJacobian);
+
+    // Performs gradient descent on the convolutions with the gradients summed by `BackPropagateConvLayers()`, then clears them
+    // `stepSize` is the learning rate divided by the number of samples summed
+    extern void DescendConvLayers(Network *net, TrainingScratch *scratch, double stepSize);
+
+    /* `sparse.c` */
+
+    // Returns 0 on success, 1 on failure
+    // Masks every weight that is currently 0, so that training can't revive it
+    extern int AllocMasks(Network *net);
+
+    // Prunes the smallest-magnitude weights of each layer until `sparsity` of the layer's weights are pruned
+    // Already-pruned weights stay pruned; requires `AllocMasks()`
+    extern void PruneNetwork(Network *net, double sparsity);
+
+    // Sparsity to prune to after `step` of `steps` pruning steps, rising quickly at first and levelling off at `target`
+    extern double PruningSchedule(double target, size_t step, size_t steps);
+
+    // Returns the fraction of weights that are exactly 0
+    extern double GetSparsity(const Network *net);
+
+    // Returns 0 on success, 1 on failure
+    // Builds `net->sparse_weights` from the current weights, used by `ForwardPassBatch()` for every layer sparse enough to benefit
+    // Must be rebuilt (or freed) whenever the weights change
+    extern int BuildSparseWeights(Network *net);
+
+    // Safe to call when `net->sparse_weights` is NULL
+    extern void FreeSparseWeights(Network *net);
+
+    /* `bf16.c` */
+
+    // Rounds `count` doubles from `in` into bfloat16s in `out`
+    extern void NarrowToBf16(size_t count, const double *in, uint16_t *out);
+
+    // Safe to call when `net->bf16_weights` is NULL
+    extern void FreeBf16Weights(Network *net);
+
+    // Returns 0 on success, 1 on failure
+    // Builds `net->bf16_weights` from the current weights, used by `ForwardPassBatch()` and batched training instead of them
+    // Scratches must be allocated afterwards, as they then hold fp32 copies of the inputs for the kernels
+    extern int BuildBf16Weights(Network *net);
+
+    // Rounds every weight into `net->bf16_weights` again, after they've been changed other than by `TrainEpoch()`
+    extern void UpdateBf16Weights(Network *net);
+
+    // `outmatrix = (matrix)(inmatrix)` for each of `batch` samples, with a bfloat16 `matrix` (see `TransformBatch()`)
+    // `inmatrix` is first rounded into `narrowed` (`batch * width` long) as fp32; each output is summed in fp32
+    extern void TransformBatchBf16(size_t width, size_t height, size_t batch, const uint16_t *matrix, const double *inmatrix, float *narrowed, double *outmatrix, size_t tile);
+
+    // `outmatrix = (matrix)^T(inmatrix)` for each of `batch` samples, with a bfloat16 `matrix` (see `TransformBatchTransposed()`)
+    // Each weight is widened, but the jacobians are summed in fp64, as they're added to one row at a time
+    extern void TransformBatchTransposedBf16(size_t width, size_t height, size_t batch, const uint16_t *matrix, const double *inmatrix, double *outmatrix, size_t tile);
+
+    /* `stats.c` */
+
+    // Returns seconds since an arbitrary fixed point; unlike `clock()`, counts wall time rather than CPU time
+    extern double GetMonotonicTime(void);
+
+    // Returns 0 on success, 1 on failure
+    extern int InitLatencyStats(LatencyStats *stats, size_t capacity);
+
+    extern void FreeLatencyStats(LatencyStats *stats);
+
+    // Forgets all recorded samples, keeping the allocation
+    extern void ResetLatencyStats(LatencyStats *stats);
+
+    // Records one latency in seconds
+    extern void RecordLatency(LatencyStats *stats, double seconds);
+
+    // Appends the samples of `src` to `dst`
+    extern void MergeLatencyStats(LatencyStats *dst, const LatencyStats *src);
+
+    // Returns the `p`th percentile (`0.0 <= p <= 1.0`) of the recorded samples; sorts the samples in place
+    extern double LatencyPercentile(LatencyStats *stats, double p);
+
+    // Prints request count, throughput and latency percentiles (in ms) on one line
+    // `elapsed` is the wall time in seconds that the samples were recorded over
+    extern void PrintLatencyStats(FILE *f, const char *label, LatencyStats *stats, double elapsed);
+
+    /* `threadpool.c` */
+
+    // Returns the number of online cores, or 1 if unknown
+    extern size_t GetCoreCount(void);
+
+    // Returns NULL on failure
+    // `thread_count == 0` uses one thread per core; the calling thread counts as one of the threads
+    extern ThreadPool *CreateThreadPool(size_t thread_count);
+
+    // Safe to call with NULL
+    extern void DestroyThreadPool(ThreadPool *pool);
+
+    // Number of threads, including the calling thread; fewer than requested if some couldn't be started
+    extern size_t ThreadPoolSize(const ThreadPool *pool);
+
+    // Runs `task` over `[0, count)` in chunks of at most `grain` indices spread across the pool, returning once all are done
+    // Not reentrant: `task` must not call `ParallelFor()` on the same pool
+    extern void ParallelFor(ThreadPool *pool, size_t count, size_t grain, ParallelTask task, void *context);
+
+    /* `workpool.c` */
+
+    // Returns NULL on failure
+    // `thread_count == 0` uses one thread per core; the calling thread counts as one of the threads
+    extern WorkPool *CreateWorkPool(size_t thread_count);
+
+    // Safe to call with NULL
+    extern void DestroyWorkPool(WorkPool *pool);
+
+    // Number of threads, including the calling thread; fewer than requested if some couldn't be started
+    extern size_t WorkPoolSize(const WorkPool *pool);
+
+    // Runs `task` over `[0, count)` in chunks of at most `grain` indices spread across the pool, returning once all are done
+    // `pool` may be NULL; loops no longer than `grain` run serially on the calling thread
+    // Not reentrant, and only one thread may post loops to a pool
+    extern void WorkPoolFor(WorkPool *pool, size_t count, size_t grain, ParallelTask task, void *context);
+
+    /* `intraop.c` */
+
+    // `outvector = (matrix)(invector)`, with the rows split across `pool`
+    // `pool` may be NULL, which is the same as `TransformVector()`
+    extern void TransformVectorParallel(WorkPool *pool, size_t width, size_t height, double *matrix, double *invector, double *outvector);
+
+    // Performs a forward pass on the network, with each layer split across `pool` (see `ForwardPass()`)
+    extern void ForwardPassParallel(WorkPool *pool, size_t inputLayerSize, double *inputLayer, size_t layers_count, size_t *layer_lengths, double **weights, double **biases,
+        double **deactivated_neurons, double **activated_neurons);
+
+    // Propagates backwards through the network and acquires jacobians, with each layer's rows split across `pool` (see `BackPropagate()`)
+    extern void BackPropagateParallel(WorkPool *pool, size_t layers_count, size_t *layer_lengths, double **weights, double **deactivated_neurons, double **activated_neurons,
+        double *intended, double **biasJacobian);
+
+    // Performs gradient descent, with each layer's rows split across `pool` (see `Descend()`)
+    extern void DescendParallel(WorkPool *pool, size_t layers_count, size_t *layer_lengths, size_t inputSize, double *inputLayer, double **activated_neurons, double **weights, double **biases,
+        double **biasesJacobian, double learningRate, unsigned char **masks);
+
+    /* `tuning.c` */
+
+    // Sets `tuning` to the settings used without tuning
+    extern void DefaultTuning(Tuning *tuning);
+
+    // Returns 0 on success, 1 on failure
+    // Times trials of `net`'s layer shapes on this host, and sets `tuning` to the fastest settings for training in batches of `training_batch` and testing
+    // `net` is left as it is
+    extern int TuneNetwork(Network *net, size_t training_batch, Tuning *tuning);
+
+    // Returns 0 on success, 1 if the cache file `filename` has no entry for `net` and `training_batch` on this host (or can't be read)
+    extern int LoadTuning(const char *filename, const Network *net, size_t training_batch, Tuning *tuning);
+
+    // Returns 0 on success, 1 on failure
+    // Adds `tuning` to the cache file `filename` (creating it if needed) as the entry for `net` and `training_batch` on this host
+    extern int SaveTuning(const char *filename, const Network *net, size_t training_batch, const Tuning *tuning);
+
+    /* `pipeline.c` */
+
+    // Returns 0 on success, 1 on failure (including more stages than dense layers, or conv/pool layers, which aren't supported)
+    // `thread_count` is the number of stages or replicas; pipelined, each batch is split into up to `micro_batches` micro-batches
+    extern int AllocParallelTrainer(ParallelTrainer *trainer, const Network *net, ParallelMode mode, size_t thread_count, size_t batch_size, size_t micro_batches);
+
+    // Safe to call on a zeroed or partially allocated `ParallelTrainer`
+    extern void FreeParallelTrainer(ParallelTrainer *trainer);
+
+    // Sets `first` and `last` (exclusive) to the dense layers of stage `stage` of a pipelined `trainer`
+    extern void GetStageLayers(const ParallelTrainer *trainer, size_t stage, size_t *first, size_t *last);
+
+    // Returns 0 on success, 1 on failure (leaving `net` as it was)
+    // Trains `net` on `count` images with `trainer->batch_size` samples per step, split across `trainer->thread_count` threads;
+    // the result is the same as `TrainEpoch()` with that batch size, up to rounding. Pruned weights (see `Network.masks`) stay pruned
+    extern int TrainEpochParallel(Network *net, ParallelTrainer *trainer, size_t count, char **images, char *labels, double learningRate);
+
+    /* `args.c` */
+
+    // Returns true if `arg` parsed completely as a number no less than `min` into `value`
+    extern bool ParseNumberArg(const char *arg, double min, double *value);
+
+    // Returns true if `arg` parsed completely as a whole number no less than `min` into `value`
+    extern bool ParseSizeArg(const char *arg, size_t min, size_t *value);
+
+    // Returns true if `arg` parsed completely as a comma-separated list of 1 to `capacity` numbers no less than `min`
+    extern bool ParseNumberList(const char *arg, double min, double *values, size_t capacity, size_t *count);
+
+    // Returns true if `arg` parsed completely as a comma-separated list of 1 to `capacity` whole numbers no less than `min`
+    extern bool ParseSizeList(const char *arg, size_t min, size_t *values, size_t capacity, size_t *count);
+
+    // Returns true if `arg` parsed completely as 1 to `list_capacity` `/`-separated lists of whole numbers no less than `min`,
+    // like `64,10/128,10`, each of 1 to `capacity` numbers
+    // List `i` is put in `values[i * capacity]` onwards, with its length in `counts[i]`
+    extern bool ParseSizeLists(const char *arg, size_t min, size_t *values, size_t capacity, size_t *counts, size_t list_capacity, size_t *list_count);
+
+    /* `socket.c` (POSIX only) */
+
+    // Addresses are either `unix:PATH` for a Unix domain socket, or `HOST:PORT` / `PORT` for TCP
+
+    // Returns a listening socket, or -1 on failure
+    extern int OpenListener(const char *address);
+
+    // Returns a connected socket, or -1 on failure
+    extern int ConnectTo(const char *address);
+
+    // Disables Nagle's algorithm on TCP sockets; harmless on Unix domain sockets
+    extern void SetLowLatency(int fd);
+
+    // Returns 0 once exactly `len` bytes are read, 1 on failure or end of stream
+    extern int ReadFull(int fd, void *buffer, size_t len);
+
+    // Returns 0 once exactly `len` bytes are written, 1 on failure
+    extern int WriteFull(int fd, const void *buffer, size_t len);
 
 
 #endif
\ No newline at end of file
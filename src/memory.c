@@ -0,0 +1,211 @@
+#include "main.h"
+
+/*
+    Activation checkpointing report: trains the same network with several checkpoint intervals and reports what each one costs and saves
+
+    Every interval starts from identical initial weights and sees the same images in the same order, so the trained weights should
+    match the interval-0 (keep everything) run exactly; the largest difference is reported to show that recomputing is lossless
+    Datasets, the learning rate and the layers come from the config file, like `cnn`
+*/
+
+#define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_EPOCHS 1
+#define MAX_INTERVALS 16
+#define MAX_LAYERS 64
+
+// Returns the largest absolute difference between any parameter of `a` and `b`, which must have the same layers
+static double MaxParameterDifference(const Network *a, const Network *b) {
+    double largest = 0.0;
+    for (size_t i = 0; i < a->total_weight_count; i++) largest = fmax(largest, fabs(a->all_weights[i] - b->all_weights[i]));
+    for (size_t i = 0; i < a->total_neuron_count; i++) largest = fmax(largest, fabs(a->all_biases[i] - b->all_biases[i]));
+    for (size_t i = 0; i < a->total_conv_param_count; i++) largest = fmax(largest, fabs(a->all_conv_params[i] - b->all_conv_params[i]));
+    return largest;
+}
+
+// Returns the number of dense layers whose neurons stay stored through a pass with `checkpoint_interval`
+static size_t CountStoredLayers(size_t layers_count, size_t checkpoint_interval) {
+    if (checkpoint_interval == 0) return layers_count;
+    size_t stored = 0;
+    for (size_t i = 0; i < layers_count; i++) {
+        if ((i + 1) % checkpoint_interval == 0 || i == layers_count - 1) stored++;
+    }
+    return stored;
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\t--layers LIST          comma-separated dense layer lengths, including the output layer (default: the config file's)\n"
+        "\t--batch N              training batch size (default %d)\n"
+        "\t--intervals LIST       comma-separated checkpoint intervals to compare; 0 keeps every layer (default 0,1,2,4)\n"
+        "\t--images N             train on only the first N training images (default: all)\n"
+        "\t--epochs N             epochs per interval (default %d)\n"
+        "\t--learning-rate R      learning rate; batches step by their mean gradient, so this usually wants to be larger than for batch 1 (default: the config file's)\n"
+        "\t--seed N               seed for the initial weights (default: the time)\n",
+        program, DEFAULT_BATCH_SIZE, DEFAULT_EPOCHS);
+}
+
+int main(int argc, char **argv) {
+    size_t intervals[MAX_INTERVALS] = { 0, 1, 2, 4 };
+    size_t intervalsCount = 4;
+    size_t argLayerLengths[MAX_LAYERS];
+    size_t argLayersCount = 0;
+    size_t batchSize = DEFAULT_BATCH_SIZE;
+    size_t imageLimit = 0;
+    size_t epochs = DEFAULT_EPOCHS;
+    size_t seed = (size_t)time(NULL);
+    double learningRate = 0.0;
+    for (int i = 1; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--layers") == 0) {
+            valid = ParseSizeList(argv[++i], 1, argLayerLengths, MAX_LAYERS, &argLayersCount);
+        } else if (valid && strcmp(argv[i], "--intervals") == 0) {
+            valid = ParseSizeList(argv[++i], 0, intervals, MAX_INTERVALS, &intervalsCount);
+        } else if (valid && strcmp(argv[i], "--batch") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &batchSize);
+        } else if (valid && strcmp(argv[i], "--images") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &imageLimit);
+        } else if (valid && strcmp(argv[i], "--epochs") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &epochs);
+        } else if (valid && strcmp(argv[i], "--learning-rate") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &learningRate) && learningRate > 0.0;
+        } else if (valid && strcmp(argv[i], "--seed") == 0) {
+            valid = ParseSizeArg(argv[++i], 0, &seed);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    char training_images_filename[MAX_PATH] = { 0 };
+    char training_labels_filename[MAX_PATH] = { 0 };
+    char testing_images_filename[MAX_PATH] = { 0 };
+    char testing_labels_filename[MAX_PATH] = { 0 };
+    char **images = NULL;
+    char *labels = NULL;
+    char **test_images = NULL;
+    char *test_labels = NULL;
+    size_t *layer_lengths = NULL;
+    ConvLayer *conv_layers = NULL;
+    Network reference = { 0 }; // trained with the first interval
+    Network network = { 0 };
+    TrainingScratch trainingScratch = { 0 };
+    NetworkScratch testingScratch = { 0 };
+
+    bool layers_count_set = false;
+    size_t layers_count = 0;
+    size_t conv_count = 0;
+    GetConfigContext configContext = { 0 };
+    configContext.layersCount_set = &layers_count_set;
+    configContext.layersCount = &layers_count;
+    configContext.layerLengths = &layer_lengths;
+    configContext.convLayersCount = &conv_count;
+    configContext.convLayers = &conv_layers;
+    if (GetDatasetConfig(CONFIG_FILENAME, training_images_filename, training_labels_filename, testing_images_filename, testing_labels_filename, &learningRate, &configContext)) {
+        fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (learningRate <= 0.0) {
+        fprintf(stderr, "No learning rate given with --learning-rate or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    const size_t *dense_lengths = argLayersCount > 0 ? argLayerLengths : layer_lengths;
+    size_t dense_count = argLayersCount > 0 ? argLayersCount : layers_count;
+    if (dense_count == 0 || dense_count + conv_count < 2) {
+        fprintf(stderr, "No layers given with --layers or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    uint32_t image_count, label_count, test_image_count, test_label_count, row_count, col_count, test_row_count, test_col_count;
+    images = GetImages(training_images_filename, &image_count, &row_count, &col_count);
+    labels = GetLabels(training_labels_filename, &label_count);
+    if (images == NULL || labels == NULL) {
+        fprintf(stderr, "Failed to retrieve training data from files \"%s\" and \"%s\".\n", training_images_filename, training_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    test_images = GetImages(testing_images_filename, &test_image_count, &test_row_count, &test_col_count);
+    test_labels = GetLabels(testing_labels_filename, &test_label_count);
+    if (test_images == NULL || test_labels == NULL || test_row_count != row_count || test_col_count != col_count) {
+        fprintf(stderr, "Failed to retrieve testing data matching the training data from files \"%s\" and \"%s\".\n", testing_images_filename, testing_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t trainingCount = image_count < label_count ? image_count : label_count;
+    if (imageLimit > 0 && imageLimit < trainingCount) trainingCount = imageLimit;
+    size_t testingCount = test_image_count < test_label_count ? test_image_count : test_label_count;
+
+    if (AllocConvNetwork(&reference, row_count, col_count, conv_count, conv_layers, dense_count, dense_lengths)) {
+        fprintf(stderr, "Failed to allocate a network for the layers given, which must fit %u x %u images.\n", col_count, row_count);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (AllocScratch(&testingScratch, &reference, TESTING_BATCH_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    printf("Training %zu dense layers (%zu neurons per sample) on %zu images, batch %zu, %zu epoch(s) per interval, learning rate %g, seed %zu\n\n",
+        dense_count, reference.total_neuron_count, trainingCount, batchSize, epochs, learningRate, seed);
+    printf("| Interval | Stored layers | Neurons (MiB) | Scratch (MiB) | Time (s) | Relative | Accuracy | Max weight diff |\n");
+    printf("| -------- | ------------- | ------------- | ------------- | -------- | -------- | -------- | --------------- |\n");
+    fflush(stdout);
+
+    double referenceTime = 0.0;
+    for (size_t i = 0; i < intervalsCount; i++) {
+        Network *net = i == 0 ? &reference : &network;
+        if (i > 0) {
+            FreeNetwork(&network);
+            if (AllocConvNetwork(&network, row_count, col_count, conv_count, conv_layers, dense_count, dense_lengths)) {
+                fprintf(stderr, "Failed to allocate memory on the heap for weights and biases.\n");
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+        }
+        // identical initial weights for every interval
+        srand((unsigned int)seed);
+        InitialiseNetwork(net);
+        FreeTrainingScratch(&trainingScratch);
+        if (AllocTrainingScratch(&trainingScratch, net, batchSize, intervals[i])) {
+            fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+
+        double start = GetMonotonicTime();
+        for (size_t epoch = 0; epoch < epochs; epoch++) TrainEpoch(net, &trainingScratch, trainingCount, images, labels, learningRate);
+        double elapsed = GetMonotonicTime() - start;
+        if (i == 0) referenceTime = elapsed;
+
+        size_t numRight = Evaluate(net, &testingScratch, testingCount, test_images, test_labels, NULL);
+        double neuronBytes = (double)(batchSize * GetScratchNeuronCount(net, intervals[i]) * sizeof(double));
+        printf("| %8zu | %13zu | %13.2f | %13.2f | %8.2f | %7.2fx | %8.4f | %15.3g |\n", intervals[i], CountStoredLayers(dense_count, intervals[i]),
+            neuronBytes / (1024.0 * 1024.0), (double)trainingScratch.bytes / (1024.0 * 1024.0), elapsed, elapsed / referenceTime,
+            (double)numRight / testingCount, MaxParameterDifference(&reference, net));
+        fflush(stdout);
+    }
+
+    CleanupLabel:
+
+    FreeScratch(&testingScratch);
+    FreeTrainingScratch(&trainingScratch);
+    FreeNetwork(&network);
+    FreeNetwork(&reference);
+    free(test_labels);
+    if (test_images != NULL) free(test_images[0]);
+    free(test_images);
+    free(labels);
+    if (images != NULL) free(images[0]);
+    free(images);
+    free(conv_layers);
+    free(layer_lengths);
+    return returnValue;
+}
\ No newline at end of file
@@ -0,0 +1,610 @@
+#include "main.h"
+
+/*
+    Contains functions for allocating, running and training networks, shared by every executable
+*/
+
+// Performs a forward pass on the network
+void ForwardPass(size_t inputLayerSize, double *inputLayer, size_t layers_count, size_t *layer_lengths, double **weights, double **biases,
+    double **deactivated_neurons, double **activated_neurons) {
+    size_t prevLength = inputLayerSize;
+    double *prevLayer = inputLayer;
+    size_t layer = 0;
+    while (layer < layers_count - 1) {
+        TransformVector(prevLength, layer_lengths[layer], weights[layer], prevLayer, deactivated_neurons[layer]);
+        AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
+        ActivateVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
+        prevLength = layer_lengths[layer];
+        prevLayer = activated_neurons[layer];
+        layer++;
+    }
+    // case for `layer == layers_count - 1` is considered manually because it uses a different activation function
+    TransformVector(prevLength, layer_lengths[layer], weights[layer], prevLayer, deactivated_neurons[layer]);
+    AddVector(layer_lengths[layer], deactivated_neurons[layer], biases[layer]);
+    ActivateOutputVector(layer_lengths[layer], deactivated_neurons[layer], activated_neurons[layer]);
+}
+
+// Propagates backwards through the network and acquires jacobians; does not perform gradient descent
+// `intended` is the ideal output that the network is training to achieve
+void BackPropagate(size_t layers_count, size_t *layer_lengths, double **weights, double **deactivated_neurons, double **activated_neurons, double *intended, double **biasJacobian) {
+
+    // NOTE: jacobians are ALL with respect to cost
+    //       `biasJacobian` used as derivative of deactivated neurons with respect to cost
+    //       `biasJacobian` of `layer - 1` used as derivative of activated neurons with respect to cost
+
+    size_t layer = layers_count - 1;
+    CostPrimeWrtDeactivated(layer_lengths[layer], biasJacobian[layer], activated_neurons[layer], intended);
+    while (layer-- > 0) {
+        // Compute activation derivative once for the layer
+        ActivationPrime(layer_lengths[layer], biasJacobian[layer], deactivated_neurons[layer]);
+
+        for (size_t row = 0; row < layer_lengths[layer]; row++) {
+            double sum = 0.0;
+            for (size_t i = 0; i < layer_lengths[layer + 1]; i++) {
+                // Weighted sum of next-layer errors
+                sum += biasJacobian[layer + 1][i] * weights[layer + 1][(i * layer_lengths[layer]) + row];
+            }
+            // Apply chain rule
+            biasJacobian[layer][row] *= sum;
+        }
+    }
+}
+
+// Safe to call on a zeroed or partially allocated `Network`
+void FreeNetwork(Network *net) {
+    FreeSparseWeights(net);
+    FreeBf16Weights(net);
+    free(net->all_masks);
+    free(net->masks);
+    free(net->all_biases);
+    free(net->all_weights);
+    free(net->biases);
+    free(net->weights);
+    free(net->layer_lengths);
+    free(net->all_conv_params);
+    free(net->conv_layers);
+    memset(net, 0, sizeof(*net));
+}
+
+// Returns 0 on success, 1 on failure
+// Weights and biases are left uninitialised; `layer_lengths` is copied
+int AllocNetwork(Network *net, size_t input_size, size_t layers_count, const size_t *layer_lengths) {
+    return AllocConvNetwork(net, 1, input_size, 0, NULL, layers_count, layer_lengths);
+}
+
+// Returns 1 if `a * b` would overflow `size_t`, otherwise sets `*product` and returns 0
+static int MultiplySizes(size_t a, size_t b, size_t *product) {
+    if (b != 0 && a > SIZE_MAX / b) return 1;
+    *product = a * b;
+    return 0;
+}
+
+// Returns 1 if `*total + value` would overflow `size_t`, otherwise adds `value` to `*total` and returns 0
+static int AddSize(size_t *total, size_t value) {
+    if (value > SIZE_MAX - *total) return 1;
+    *total += value;
+    return 0;
+}
+
+// Returns 0 on success, 1 on failure (including conv/pool layers that don't fit the images, or sizes that overflow `size_t`)
+// Like `AllocNetwork()`, with `conv_count` conv/pool layers ahead of the dense layers, for `input_rows * input_cols` images
+// `conv_layers` is copied, with shapes filled in by `GetConvShapes()`; it may be NULL if `conv_count` is 0
+int AllocConvNetwork(Network *net, size_t input_rows, size_t input_cols, size_t conv_count, const ConvLayer *conv_layers,
+    size_t layers_count, const size_t *layer_lengths) {
+    memset(net, 0, sizeof(*net));
+    // sizes come from config and `.nn` files, so every product and total is checked before anything is allocated
+    if (MultiplySizes(input_rows, input_cols, &net->input_size) || layers_count > SIZE_MAX / sizeof(double*)) return 1;
+    net->dense_input_size = net->input_size;
+    net->layers_count = layers_count;
+    net->layer_lengths = malloc(layers_count * sizeof(size_t));
+    net->weights = malloc(layers_count * sizeof(double*));
+    net->biases = malloc(layers_count * sizeof(double*));
+    if (net->layer_lengths == NULL || net->weights == NULL || net->biases == NULL) goto AllocFailLabel;
+    memcpy(net->layer_lengths, layer_lengths, layers_count * sizeof(size_t));
+
+    if (conv_count > 0) {
+        net->conv_layers = malloc(conv_count * sizeof(ConvLayer));
+        if (net->conv_layers == NULL) goto AllocFailLabel;
+        memcpy(net->conv_layers, conv_layers, conv_count * sizeof(ConvLayer));
+        net->conv_count = conv_count;
+        if (GetConvShapes(input_rows, input_cols, conv_count, net->conv_layers)) goto AllocFailLabel;
+        for (size_t i = 0; i < conv_count; i++) {
+            ConvLayer *layer = &net->conv_layers[i];
+            size_t area, outputSize, window, params;
+            if (MultiplySizes(layer->out_height, layer->out_width, &area) || MultiplySizes(area, layer->out_channels, &outputSize)) goto AllocFailLabel;
+            if (layer->type != CONV_LAYER) continue;
+            if (MultiplySizes(layer->kernel * layer->kernel, layer->in_channels, &window) || window == SIZE_MAX || MultiplySizes(layer->filters, window + 1, &params)
+                || AddSize(&net->total_conv_param_count, params)) goto AllocFailLabel;
+        }
+        if (net->total_conv_param_count > SIZE_MAX / sizeof(double)) goto AllocFailLabel;
+        net->dense_input_size = ConvOutputSize(&net->conv_layers[conv_count - 1]);
+        if (net->total_conv_param_count > 0) {
+            net->all_conv_params = malloc(net->total_conv_param_count * sizeof(double));
+            if (net->all_conv_params == NULL) goto AllocFailLabel;
+        }
+        size_t paramOffset = 0;
+        for (size_t i = 0; i < conv_count; i++) {
+            ConvLayer *layer = &net->conv_layers[i];
+            layer->weights = NULL;
+            layer->biases = NULL;
+            if (layer->type != CONV_LAYER) continue;
+            layer->weights = &net->all_conv_params[paramOffset];
+            paramOffset += layer->filters * layer->kernel * layer->kernel * layer->in_channels;
+            layer->biases = &net->all_conv_params[paramOffset];
+            paramOffset += layer->filters;
+        }
+    }
+
+    size_t prevLength = net->dense_input_size;
+    for (size_t i = 0; i < layers_count; i++) {
+        size_t count;
+        if (MultiplySizes(prevLength, layer_lengths[i], &count) || AddSize(&net->total_weight_count, count) || AddSize(&net->total_neuron_count, layer_lengths[i])) goto AllocFailLabel;
+        prevLength = layer_lengths[i];
+    }
+    if (net->total_weight_count > SIZE_MAX / sizeof(double) || net->total_neuron_count > SIZE_MAX / sizeof(double)) goto AllocFailLabel;
+    net->all_weights = malloc(net->total_weight_count * sizeof(double));
+    net->all_biases = malloc(net->total_neuron_count * sizeof(double));
+    if (net->all_weights == NULL || net->all_biases == NULL) goto AllocFailLabel;
+
+    size_t weightOffset = 0;
+    size_t biasOffset = 0;
+    prevLength = net->dense_input_size;
+    for (size_t i = 0; i < layers_count; i++) {
+        net->weights[i] = &net->all_weights[weightOffset];
+        net->biases[i] = &net->all_biases[biasOffset];
+        weightOffset += prevLength * layer_lengths[i];
+        biasOffset += layer_lengths[i];
+        prevLength = layer_lengths[i];
+    }
+    return 0;
+
+    AllocFailLabel:
+    FreeNetwork(net);
+    return 1;
+}
+
+// Initialises weights to random (He initialisation) and biases to 0
+// Uses `rand()`, so seed with `srand()` beforehand
+void InitialiseNetwork(Network *net) {
+    for (size_t i = 0; i < net->conv_count; i++) {
+        ConvLayer *layer = &net->conv_layers[i];
+        if (layer->type != CONV_LAYER) continue;
+        size_t window = layer->kernel * layer->kernel * layer->in_channels;
+        for (size_t j = 0; j < layer->filters * window; j++) layer->weights[j] = sqrt(2.0 / window) * ((double)rand() / (double)RAND_MAX - 0.5);
+        memset(layer->biases, 0, layer->filters * sizeof(double));
+    }
+    size_t prevLength = net->dense_input_size;
+    for (size_t i = 0; i < net->layers_count; i++) {
+        for (size_t j = 0; j < prevLength * net->layer_lengths[i]; j++) net->weights[i][j] = sqrt(2.0 / prevLength) * ((double)rand() / (double)RAND_MAX - 0.5);
+        prevLength = net->layer_lengths[i];
+    }
+    memset(net->all_biases, 0, net->total_neuron_count * sizeof(double));
+}
+
+// Safe to call on a zeroed or partially allocated `NetworkScratch`
+void FreeScratch(NetworkScratch *scratch) {
+    free(scratch->narrowed_inputs);
+    free(scratch->columns);
+    free(scratch->all_conv_outputs);
+    free(scratch->conv_outputs);
+    free(scratch->all_activated_neurons); // `all_deactivated_neurons` shares its allocation
+    free(scratch->activated_neurons);
+    free(scratch->deactivated_neurons);
+    free(scratch->inputs);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Returns true if `layer` keeps its own activated neurons in a `NetworkScratch` with `checkpoint_interval`
+static bool IsCheckpoint(size_t layer, size_t layers_count, size_t checkpoint_interval) {
+    return checkpoint_interval == 0 || (layer + 1) % checkpoint_interval == 0 || layer == layers_count - 1;
+}
+
+// Returns the number of dense layer neurons a `NetworkScratch` with `checkpoint_interval` holds per sample
+size_t GetScratchNeuronCount(const Network *net, size_t checkpoint_interval) {
+    if (checkpoint_interval == 0) return 2 * net->total_neuron_count; // deactivated and activated
+    size_t checkpoints = 0;
+    size_t segment = 0;
+    size_t largestSegment = 0;
+    for (size_t i = 0; i < net->layers_count; i++) {
+        if (IsCheckpoint(i, net->layers_count, checkpoint_interval)) {
+            checkpoints += net->layer_lengths[i];
+            segment = 0;
+        } else {
+            segment += net->layer_lengths[i];
+            if (segment > largestSegment) largestSegment = segment;
+        }
+    }
+    return checkpoints + largestSegment;
+}
+
+// Returns 0 on success, 1 on failure
+int AllocScratch(NetworkScratch *scratch, const Network *net, size_t batch_capacity) {
+    return AllocCheckpointedScratch(scratch, net, batch_capacity, 0);
+}
+
+// Returns 0 on success, 1 on failure
+// Like `AllocScratch()`, keeping only the neurons described by `NetworkScratch.checkpoint_interval`
+int AllocCheckpointedScratch(NetworkScratch *scratch, const Network *net, size_t batch_capacity, size_t checkpoint_interval) {
+    memset(scratch, 0, sizeof(*scratch));
+    scratch->batch_capacity = batch_capacity;
+    scratch->checkpoint_interval = checkpoint_interval;
+    size_t neuronCount = batch_capacity * GetScratchNeuronCount(net, checkpoint_interval);
+    scratch->inputs = malloc(batch_capacity * net->input_size * sizeof(double));
+    scratch->deactivated_neurons = malloc(net->layers_count * sizeof(double*));
+    scratch->activated_neurons = malloc(net->layers_count * sizeof(double*));
+    scratch->all_activated_neurons = malloc(neuronCount * sizeof(double));
+    if (scratch->inputs == NULL || scratch->deactivated_neurons == NULL || scratch->activated_neurons == NULL || scratch->all_activated_neurons == NULL) {
+        FreeScratch(scratch);
+        return 1;
+    }
+    scratch->bytes = (batch_capacity * net->input_size + neuronCount) * sizeof(double);
+    if (checkpoint_interval == 0) {
+        // both halves of `neuronCount`
+        scratch->all_deactivated_neurons = &scratch->all_activated_neurons[batch_capacity * net->total_neuron_count];
+        size_t offset = 0;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            scratch->deactivated_neurons[i] = &scratch->all_deactivated_neurons[offset];
+            scratch->activated_neurons[i] = &scratch->all_activated_neurons[offset];
+            offset += batch_capacity * net->layer_lengths[i];
+        }
+    } else {
+        // checkpoints first, then the segment buffer
+        size_t offset = 0;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            if (!IsCheckpoint(i, net->layers_count, checkpoint_interval)) continue;
+            scratch->activated_neurons[i] = &scratch->all_activated_neurons[offset];
+            offset += batch_capacity * net->layer_lengths[i];
+        }
+        size_t segmentOffset = offset;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            if (IsCheckpoint(i, net->layers_count, checkpoint_interval)) {
+                segmentOffset = offset;
+            } else {
+                scratch->activated_neurons[i] = &scratch->all_activated_neurons[segmentOffset];
+                segmentOffset += batch_capacity * net->layer_lengths[i];
+            }
+            scratch->deactivated_neurons[i] = scratch->activated_neurons[i];
+        }
+    }
+
+    if (net->conv_count > 0) {
+        size_t convOutputCount = 0;
+        size_t columnCount = 0;
+        for (size_t i = 0; i < net->conv_count; i++) {
+            const ConvLayer *layer = &net->conv_layers[i];
+            convOutputCount += ConvOutputSize(layer);
+            size_t layerColumns = layer->out_height * layer->out_width * layer->kernel * layer->kernel * layer->in_channels;
+            if (layer->type == CONV_LAYER && layerColumns > columnCount) columnCount = layerColumns;
+        }
+        scratch->conv_outputs = malloc(net->conv_count * sizeof(double*));
+        scratch->all_conv_outputs = malloc(batch_capacity * convOutputCount * sizeof(double));
+        scratch->columns = malloc((columnCount + 1) * sizeof(double)); // never 0 bytes, even with only pools
+        if (scratch->conv_outputs == NULL || scratch->all_conv_outputs == NULL || scratch->columns == NULL) {
+            FreeScratch(scratch);
+            return 1;
+        }
+        scratch->bytes += (batch_capacity * convOutputCount + columnCount + 1) * sizeof(double);
+        size_t offset = 0;
+        for (size_t i = 0; i < net->conv_count; i++) {
+            scratch->conv_outputs[i] = &scratch->all_conv_outputs[offset];
+            offset += batch_capacity * ConvOutputSize(&net->conv_layers[i]);
+        }
+    }
+
+    if (net->bf16_weights != NULL) {
+        size_t widest = net->dense_input_size;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            if (net->layer_lengths[i] > widest) widest = net->layer_lengths[i];
+        }
+        scratch->narrowed_inputs = malloc(batch_capacity * widest * sizeof(float));
+        if (scratch->narrowed_inputs == NULL) {
+            FreeScratch(scratch);
+            return 1;
+        }
+        scratch->bytes += batch_capacity * widest * sizeof(float);
+    }
+    return 0;
+}
+
+// Converts `count` raw images into rows of `inputs`, scaled to [0, 1]
+void LoadInputs(size_t count, size_t input_size, char **images, double *inputs) {
+    for (size_t b = 0; b < count; b++) {
+        for (size_t i = 0; i < input_size; i++) inputs[(b * input_size) + i] = (double)(unsigned char)images[b][i] / UCHAR_MAX;
+    }
+}
+
+// Performs a forward pass on `batch` samples at once
+// `inputs` holds one sample per row (`batch * net->input_size`); `batch` must not exceed `scratch->batch_capacity`
+// The outputs of sample `b` are at `&scratch->activated_neurons[net->layers_count - 1][b * output length]`
+void ForwardPassBatch(const Network *net, size_t batch, double *inputs, NetworkScratch *scratch) {
+    size_t prevLength = net->dense_input_size;
+    double *prevLayer = inputs;
+    if (net->conv_count > 0) {
+        ConvForwardBatch(net, batch, inputs, scratch);
+        prevLayer = scratch->conv_outputs[net->conv_count - 1];
+    }
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        size_t length = net->layer_lengths[layer];
+        double *deactivated = scratch->deactivated_neurons[layer];
+        if (net->sparse_weights != NULL && net->sparse_weights[layer].row_starts != NULL) {
+            SparseTransformBatch(&net->sparse_weights[layer], batch, prevLayer, deactivated);
+        } else if (net->bf16_weights != NULL) {
+            TransformBatchBf16(prevLength, length, batch, net->bf16_weights[layer], prevLayer, scratch->narrowed_inputs, deactivated, scratch->tiles.forward);
+        } else if (batch == 1) {
+            TransformVectorParallel(scratch->pool, prevLength, length, net->weights[layer], prevLayer, deactivated);
+        } else {
+            TransformBatch(prevLength, length, batch, net->weights[layer], prevLayer, deactivated, scratch->tiles.forward);
+        }
+        for (size_t b = 0; b < batch; b++) AddVector(length, &deactivated[b * length], net->biases[layer]);
+        // the last layer uses a different activation function
+        if (layer == net->layers_count - 1) {
+            ActivateOutputVector(batch * length, deactivated, scratch->activated_neurons[layer]);
+        } else {
+            ActivateVector(batch * length, deactivated, scratch->activated_neurons[layer]);
+        }
+        prevLength = length;
+        prevLayer = scratch->activated_neurons[layer];
+    }
+}
+
+// Returns the number of multiply-adds in the convolutions and dense layers of one forward pass of one sample
+size_t CountMultiplyAdds(const Network *net) {
+    size_t count = net->total_weight_count;
+    for (size_t i = 0; i < net->conv_count; i++) {
+        const ConvLayer *layer = &net->conv_layers[i];
+        if (layer->type == CONV_LAYER) count += layer->out_height * layer->out_width * layer->filters * layer->kernel * layer->kernel * layer->in_channels;
+    }
+    return count;
+}
+
+// Returns the index of the largest element (the predicted class for an output layer)
+size_t ArgMax(size_t len, const double *vector) {
+    size_t largestindex = 0;
+    for (size_t i = 1; i < len; i++) {
+        if (vector[i] > vector[largestindex]) largestindex = i;
+    }
+    return largestindex;
+}
+
+// Safe to call on a zeroed or partially allocated `TrainingScratch`
+void FreeTrainingScratch(TrainingScratch *scratch) {
+    FreeScratch(&scratch->forward);
+    free(scratch->conv_gradients);
+    free(scratch->column_jacobians);
+    free(scratch->conv_jacobians[1]);
+    free(scratch->conv_jacobians[0]);
+    free(scratch->batch_jacobians[1]);
+    free(scratch->batch_jacobians[0]);
+    free(scratch->intended_output);
+    free(scratch->all_bias_jacobians);
+    free(scratch->bias_jacobians);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Returns 0 on success, 1 on failure
+// `batch_capacity` of 1 with no `checkpoint_interval` trains one sample at a time with `BackPropagate()` and `Descend()`;
+// anything else trains in batches, which also supports checkpointing (see `NetworkScratch`)
+int AllocTrainingScratch(TrainingScratch *scratch, const Network *net, size_t batch_capacity, size_t checkpoint_interval) {
+    memset(scratch, 0, sizeof(*scratch));
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    scratch->intended_output = malloc(batch_capacity * output_size * sizeof(double));
+    if (scratch->intended_output == NULL || AllocCheckpointedScratch(&scratch->forward, net, batch_capacity, checkpoint_interval)) {
+        FreeTrainingScratch(scratch);
+        return 1;
+    }
+    scratch->bytes = scratch->forward.bytes + batch_capacity * output_size * sizeof(double);
+    if (batch_capacity == 1 && checkpoint_interval == 0) {
+        scratch->bias_jacobians = malloc(net->layers_count * sizeof(double*));
+        scratch->all_bias_jacobians = malloc(net->total_neuron_count * sizeof(double));
+        if (scratch->bias_jacobians == NULL || scratch->all_bias_jacobians == NULL) {
+            FreeTrainingScratch(scratch);
+            return 1;
+        }
+        scratch->bytes += net->total_neuron_count * sizeof(double);
+        size_t offset = 0;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            scratch->bias_jacobians[i] = &scratch->all_bias_jacobians[offset];
+            offset += net->layer_lengths[i];
+        }
+    } else {
+        // batches only need the jacobians of the layer being descended and the one before it
+        size_t largestLayer = 0;
+        for (size_t i = 0; i < net->layers_count; i++) {
+            if (net->layer_lengths[i] > largestLayer) largestLayer = net->layer_lengths[i];
+        }
+        scratch->batch_jacobians[0] = malloc(batch_capacity * largestLayer * sizeof(double));
+        scratch->batch_jacobians[1] = malloc(batch_capacity * largestLayer * sizeof(double));
+        if (scratch->batch_jacobians[0] == NULL || scratch->batch_jacobians[1] == NULL) {
+            FreeTrainingScratch(scratch);
+            return 1;
+        }
+        scratch->bytes += 2 * batch_capacity * largestLayer * sizeof(double);
+    }
+
+    if (net->conv_count > 0) {
+        // each buffer holds the input or output of any conv/pool layer
+        size_t jacobianCount = net->dense_input_size;
+        size_t columnCount = 0;
+        for (size_t i = 0; i < net->conv_count; i++) {
+            const ConvLayer *layer = &net->conv_layers[i];
+            size_t inputSize = layer->in_height * layer->in_width * layer->in_channels;
+            size_t layerColumns = layer->out_height * layer->out_width * layer->kernel * layer->kernel * layer->in_channels;
+            if (inputSize > jacobianCount) jacobianCount = inputSize;
+            if (layer->type == CONV_LAYER && layerColumns > columnCount) columnCount = layerColumns;
+        }
+        scratch->conv_jacobians[0] = malloc(jacobianCount * sizeof(double));
+        scratch->conv_jacobians[1] = malloc(jacobianCount * sizeof(double));
+        scratch->column_jacobians = malloc((columnCount + 1) * sizeof(double));
+        scratch->conv_gradients = calloc(net->total_conv_param_count + 1, sizeof(double));
+        if (scratch->conv_jacobians[0] == NULL || scratch->conv_jacobians[1] == NULL || scratch->column_jacobians == NULL || scratch->conv_gradients == NULL) {
+            FreeTrainingScratch(scratch);
+            return 1;
+        }
+        scratch->bytes += (2 * jacobianCount + columnCount + 1 + net->total_conv_param_count + 1) * sizeof(double);
+    }
+    return 0;
+}
+
+// Runs dense layers `[first, last)` of a batch, reading `denseInput` for layer 0
+// Always uses the dense (or bfloat16) weights, as `net->sparse_weights` may be stale during training
+static void ForwardLayers(const Network *net, size_t batch, double *denseInput, NetworkScratch *scratch, size_t first, size_t last) {
+    for (size_t layer = first; layer < last; layer++) {
+        size_t length = net->layer_lengths[layer];
+        size_t prevLength = layer == 0 ? net->dense_input_size : net->layer_lengths[layer - 1];
+        double *prevLayer = layer == 0 ? denseInput : scratch->activated_neurons[layer - 1];
+        double *deactivated = scratch->deactivated_neurons[layer];
+        if (net->bf16_weights != NULL) {
+            TransformBatchBf16(prevLength, length, batch, net->bf16_weights[layer], prevLayer, scratch->narrowed_inputs, deactivated, scratch->tiles.forward);
+        } else {
+            TransformBatch(prevLength, length, batch, net->weights[layer], prevLayer, deactivated, scratch->tiles.forward);
+        }
+        for (size_t b = 0; b < batch; b++) AddVector(length, &deactivated[b * length], net->biases[layer]);
+        // the last layer uses a different activation function
+        if (layer == net->layers_count - 1) {
+            ActivateOutputVector(batch * length, deactivated, scratch->activated_neurons[layer]);
+        } else {
+            ActivateVector(batch * length, deactivated, scratch->activated_neurons[layer]);
+        }
+    }
+}
+
+// Trains `net` on the `batch` samples in `scratch->forward.inputs` with one step of their mean gradient
+//
+// NOTE: each layer is descended as soon as the jacobian of the layer before it has been found, so only two layers of jacobians are ever held;
+//       with checkpointing, each segment between checkpoints is recomputed from the checkpoint before it when backpropagation reaches it
+static void TrainBatch(Network *net, TrainingScratch *scratch, size_t batch, const char *labels, double learningRate) {
+    NetworkScratch *forward = &scratch->forward;
+    size_t layers_count = net->layers_count;
+    size_t output_size = net->layer_lengths[layers_count - 1];
+    size_t interval = forward->checkpoint_interval;
+    double *denseInput = forward->inputs;
+    if (net->conv_count > 0) {
+        ConvForwardBatch(net, batch, forward->inputs, forward);
+        denseInput = forward->conv_outputs[net->conv_count - 1];
+    }
+    ForwardLayers(net, batch, denseInput, forward, 0, layers_count);
+
+    (void)memset(scratch->intended_output, 0, batch * output_size * sizeof(double));
+    double *jacobians = scratch->batch_jacobians[0];
+    for (size_t b = 0; b < batch; b++) {
+        scratch->intended_output[(b * output_size) + (unsigned char)labels[b]] = 1.0;
+        CostPrimeWrtDeactivated(output_size, &jacobians[b * output_size], &forward->activated_neurons[layers_count - 1][b * output_size], &scratch->intended_output[b * output_size]);
+    }
+
+    double stepSize = learningRate / (double)batch;
+    // the last segment is still held from the forward pass
+    size_t segmentStart = 0;
+    for (size_t i = 0; interval > 0 && i < layers_count; i++) {
+        if (!IsCheckpoint(i, layers_count, interval)) segmentStart = i - (i % interval);
+    }
+    for (size_t layer = layers_count; layer-- > 0;) {
+        if (layer < segmentStart) {
+            // `layer` is the checkpoint ending the previous segment
+            segmentStart = layer - (layer % interval);
+            ForwardLayers(net, batch, denseInput, forward, segmentStart, layer);
+        }
+        size_t length = net->layer_lengths[layer];
+        size_t prevLength = layer == 0 ? net->dense_input_size : net->layer_lengths[layer - 1];
+        double *prevLayer = layer == 0 ? denseInput : forward->activated_neurons[layer - 1];
+        double *prevJacobians = scratch->batch_jacobians[(layers_count - layer) % 2];
+        // must use the weights from before this descent
+        if (layer > 0) {
+            if (net->bf16_weights != NULL) {
+                TransformBatchTransposedBf16(prevLength, length, batch, net->bf16_weights[layer], jacobians, prevJacobians, forward->tiles.backward);
+            } else {
+                TransformBatchTransposed(prevLength, length, batch, net->weights[layer], jacobians, prevJacobians, forward->tiles.backward);
+            }
+            // the ReLU derivative is found from the activated neurons, which are only 0 where the deactivated neurons were negative
+            for (size_t i = 0; i < batch * prevLength; i++) {
+                if (prevLayer[i] <= 0.0) prevJacobians[i] = 0.0;
+            }
+        } else if (net->conv_count > 0) {
+            // the convolutions are backpropagated one sample at a time, as their jacobians are only ever held for one sample, but
+            // their gradients are summed over the batch and descended once, like the dense layers'
+            for (size_t b = 0; b < batch; b++) BackPropagateConvLayers(net, scratch, b, &forward->inputs[b * net->input_size], &jacobians[b * length]);
+            DescendConvLayers(net, scratch, stepSize);
+        }
+        DescendBatch(prevLength, length, batch, prevLayer, net->weights[layer], net->biases[layer], jacobians, stepSize, net->masks == NULL ? NULL : net->masks[layer],
+            forward->tiles.update);
+        // the fp64 weights are the master copy; the step is usually far smaller than a bfloat16's precision, so is only seen once it adds up
+        if (net->bf16_weights != NULL) NarrowToBf16(prevLength * length, net->weights[layer], net->bf16_weights[layer]);
+        jacobians = prevJacobians;
+    }
+}
+
+// Trains `net` on `count` images with stochastic gradient descent, `scratch->forward.batch_capacity` samples at a time
+// Pruned weights (see `Network.masks`) stay pruned
+// With `net->bf16_weights`, batches run on them and step the fp64 weights (mixed precision); one sample at a time runs on the
+// fp64 weights, which are rounded into the bfloat16 ones at the end
+void TrainEpoch(Network *net, TrainingScratch *scratch, size_t count, char **images, char *labels, double learningRate) {
+    if (scratch->bias_jacobians == NULL) {
+        for (size_t begin = 0; begin < count; begin += scratch->forward.batch_capacity) {
+            size_t batch = count - begin < scratch->forward.batch_capacity ? count - begin : scratch->forward.batch_capacity;
+            LoadInputs(batch, net->input_size, &images[begin], scratch->forward.inputs);
+            TrainBatch(net, scratch, batch, &labels[begin], learningRate);
+        }
+        return;
+    }
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    double *inputLayer = scratch->forward.inputs;
+    for (size_t image = 0; image < count; image++) {
+        LoadInputs(1, net->input_size, &images[image], inputLayer); // set input layer
+        double *denseInput = inputLayer;
+        if (net->conv_count > 0) {
+            ConvForwardBatch(net, 1, inputLayer, &scratch->forward);
+            denseInput = scratch->forward.conv_outputs[net->conv_count - 1];
+        }
+        ForwardPassParallel(scratch->forward.pool, net->dense_input_size, denseInput, net->layers_count, net->layer_lengths, net->weights, net->biases,
+            scratch->forward.deactivated_neurons, scratch->forward.activated_neurons);
+
+        (void)memset(scratch->intended_output, 0, output_size * sizeof(double));
+        scratch->intended_output[(unsigned char)labels[image]] = 1.0;
+
+        BackPropagateParallel(scratch->forward.pool, net->layers_count, net->layer_lengths, net->weights, scratch->forward.deactivated_neurons, scratch->forward.activated_neurons,
+            scratch->intended_output, scratch->bias_jacobians);
+        if (net->conv_count > 0) {
+            BackPropagateConvLayers(net, scratch, 0, inputLayer, scratch->bias_jacobians[0]);
+            DescendConvLayers(net, scratch, learningRate);
+        }
+        DescendParallel(scratch->forward.pool, net->layers_count, net->layer_lengths, net->dense_input_size, denseInput, scratch->forward.activated_neurons, net->weights, net->biases,
+            scratch->bias_jacobians, learningRate, net->masks);
+    }
+    if (net->bf16_weights != NULL) UpdateBf16Weights(net);
+}
+
+// Returns the number of `count` images that `net` classifies correctly, running them `scratch->batch_capacity` at a time
+// If `totalCost` isn't NULL, it's set to the sum of `Cost()` over every image
+size_t Evaluate(const Network *net, NetworkScratch *scratch, size_t count, char **images, char *labels, double *totalCost) {
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    size_t numRight = 0;
+    double cost = 0.0;
+    for (size_t begin = 0; begin < count; begin += scratch->batch_capacity) {
+        size_t batch = count - begin < scratch->batch_capacity ? count - begin : scratch->batch_capacity;
+        LoadInputs(batch, net->input_size, &images[begin], scratch->inputs);
+        ForwardPassBatch(net, batch, scratch->inputs, scratch);
+        for (size_t b = 0; b < batch; b++) {
+            double *output = &scratch->activated_neurons[net->layers_count - 1][b * output_size];
+            size_t label = (unsigned char)labels[begin + b];
+            if (ArgMax(output_size, output) == label) numRight++;
+            // `Cost()` against the one-hot vector for `label`
+            for (size_t i = 0; i < output_size; i++) {
+                double error = output[i] - (i == label ? 1.0 : 0.0);
+                cost += error * error;
+            }
+        }
+    }
+    if (totalCost != NULL) *totalCost = cost;
+    return numRight;
+}
+
+// Returns the fastest of `runs` timed passes of `Evaluate()` over `count` images, in seconds
+double TimeInference(const Network *net, NetworkScratch *scratch, size_t count, char **images, char *labels, size_t runs) {
+    double best = 0.0;
+    for (size_t run = 0; run < runs; run++) {
+        double start = GetMonotonicTime();
+        (void)Evaluate(net, scratch, count, images, labels, NULL);
+        double elapsed = GetMonotonicTime() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
\ No newline at end of file
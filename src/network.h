@@ -0,0 +1,138 @@
+#ifndef _NETWORK_H
+    #define _NETWORK_H
+
+
+    #include <stddef.h>
+    #include <stdint.h>
+    #include "threadpool.h" // contains `WorkPool`
+
+    // Compressed sparse row matrix; row `i` holds `values[j]` at column `col_indices[j]` for `row_starts[i] <= j < row_starts[i + 1]`
+    typedef struct CsrMatrix {
+        size_t rows;
+        size_t cols;
+        size_t nnz; // number of stored (nonzero) values
+        size_t *row_starts; // `rows + 1` long
+        uint32_t *col_indices;
+        double *values;
+    } CsrMatrix;
+
+    #define CONV_LAYER 0 // convolution followed by ReLU
+    #define MAX_POOL_LAYER 1
+    #define AVG_POOL_LAYER 2
+
+    // A convolution or pooling layer; these all come before the dense layers, which see the last one's output flattened
+    // Feature maps are stored channels-last: the value of channel `c` at `(y, x)` is at `[((y * width) + x) * channels + c]`
+    // (an image is a single channel)
+    typedef struct ConvLayer {
+        int type; // `CONV_LAYER`, `MAX_POOL_LAYER` or `AVG_POOL_LAYER`
+        size_t kernel; // width and height of the square window
+        size_t stride;
+        size_t filters; // output channels of a convolution; pools keep their input's channels
+        // set by `AllocConvNetwork()`
+        size_t in_channels, in_height, in_width;
+        size_t out_channels, out_height, out_width;
+        double *weights; // `filters` rows of `kernel * kernel * in_channels`, ordered like a window of the input; NULL for pools
+        double *biases; // `filters` long; NULL for pools
+    } ConvLayer;
+
+    // Everything needed to run a trained network, with each parameter group stored contiguously for cache locality
+    // Weights are row-major; col is source neuron, row is dest neuron
+    //
+    // NOTE: never modified by inference, so one `Network` can be shared by any number of threads
+    typedef struct Network {
+        size_t input_size; // pixels per image
+        size_t conv_count; // convolution and pooling layers, ahead of the dense layers
+        ConvLayer *conv_layers;
+        double *all_conv_params; // every convolution's weights and biases
+        size_t total_conv_param_count;
+        size_t dense_input_size; // input width of the first dense layer: `input_size`, or the output size of the last conv/pool layer
+        size_t layers_count; // dense layers, excluding the input layer, including the output layer
+        size_t *layer_lengths;
+        double **weights; // each element points into `all_weights`
+        double *all_weights;
+        size_t total_weight_count;
+        double **biases; // each element points into `all_biases`
+        double *all_biases;
+        size_t total_neuron_count;
+        unsigned char **masks; // NULL unless pruning; 0 for each pruned weight, which `Descend()` then never updates
+        unsigned char *all_masks;
+        CsrMatrix *sparse_weights; // NULL unless built by `BuildSparseWeights()`; layers left dense have `row_starts == NULL`
+        uint16_t **bf16_weights; // NULL unless built by `BuildBf16Weights()`; each element points into `all_bf16_weights`
+        uint16_t *all_bf16_weights; // `all_weights` rounded to bfloat16, which the kernels then use instead
+    } Network;
+
+    // How many weights the batched kernels do at a time, found by `TuneNetwork()`; 0 leaves a kernel unblocked
+    // Results don't depend on these, only speed does
+    typedef struct KernelTiles {
+        size_t forward; // weight columns per block in `TransformBatch()`
+        size_t backward; // weight rows per block in `TransformBatchTransposed()`
+        size_t update; // weight columns per block in `DescendBatch()`
+    } KernelTiles;
+
+    // Per-thread buffers for running up to `batch_capacity` samples through a `Network` at once
+    // Sample `b` of layer `i` is at `activated_neurons[i][b * layer_lengths[i]]`
+    //
+    // With a `checkpoint_interval`, deactivated neurons aren't kept (`deactivated_neurons[i] == activated_neurons[i]`, as activation is done in place),
+    // and only every `checkpoint_interval`th layer and the output layer (the checkpoints) have their own activated neurons;
+    // the layers between two checkpoints share one buffer with every other such segment, so only one segment is held at a time
+    typedef struct NetworkScratch {
+        size_t batch_capacity;
+        size_t checkpoint_interval; // 0 keeps every layer's deactivated and activated neurons
+        double *inputs; // `batch_capacity * input_size`
+        double **deactivated_neurons;
+        double *all_deactivated_neurons; // part of the `all_activated_neurons` allocation; NULL with a `checkpoint_interval`
+        double **activated_neurons;
+        double *all_activated_neurons;
+        double **conv_outputs; // per conv/pool layer, `batch_capacity * out size`; convolutions are stored activated
+        double *all_conv_outputs;
+        double *columns; // im2col buffer for one sample of the largest convolution
+        float *narrowed_inputs; // fp32 copy of a layer's inputs for the bfloat16 kernels; NULL unless the network had `bf16_weights` when allocated
+        size_t bytes; // total size of the buffers, for reporting
+        WorkPool *pool; // NULL (as allocated) runs serially; otherwise single samples have each layer split across it (see `intraop.c`)
+        KernelTiles tiles; // all 0 (as allocated) leaves every kernel unblocked
+    } NetworkScratch;
+
+    // Per-thread buffers for training a `Network`, one sample at a time, or in batches of `forward.batch_capacity`
+    typedef struct TrainingScratch {
+        NetworkScratch forward;
+        double **bias_jacobians; // derivative of cost with respect to each deactivated neuron; one sample at a time only
+        double *all_bias_jacobians;
+        double *batch_jacobians[2]; // derivative of cost with respect to a layer's deactivated neurons, swapped each layer; batches only
+        double *intended_output;
+        double *conv_jacobians[2]; // derivative of cost with respect to a conv/pool layer's output and input, swapped each layer
+        double *column_jacobians; // derivative of cost with respect to `forward.columns`
+        double *conv_gradients; // derivative of cost with respect to `Network.all_conv_params`, summed over a batch
+        size_t bytes; // total size of the buffers, including `forward`'s, for reporting
+    } TrainingScratch;
+
+    // Settings for running a network fastest on this host, found by `TuneNetwork()`
+    typedef struct Tuning {
+        KernelTiles tiles;
+        size_t testing_batch; // samples per forward pass when testing
+        size_t threads; // for splitting single-sample training steps across (see `intraop.c`); 1 runs serially
+    } Tuning;
+
+    // How `TrainEpochParallel()` splits training across threads
+    typedef enum ParallelMode {
+        PIPELINE_PARALLEL, // each thread owns a group of layers, with micro-batches flowing between them
+        DATA_PARALLEL // each thread runs a share of every batch through every layer
+    } ParallelMode;
+
+    // Opaque; see `pipeline.c`
+    typedef struct TrainerWorker TrainerWorker;
+    typedef struct TrainerQueue TrainerQueue;
+
+    // Threads and buffers for training a dense `Network` with `TrainEpochParallel()`
+    typedef struct ParallelTrainer {
+        ParallelMode mode;
+        size_t thread_count; // pipeline stages or data-parallel replicas
+        size_t batch_size; // samples per step of gradient descent
+        size_t micro_batch; // samples per micro-batch (pipelined) or per replica (data-parallel)
+        TrainerWorker *workers; // `thread_count` long
+        TrainerQueue *queues; // pipelined only: forward then backward queue between each pair of neighbouring stages
+        size_t bytes; // total size of the buffers, for reporting
+        KernelTiles tiles; // all 0 (as allocated) leaves every kernel unblocked
+    } ParallelTrainer;
+
+
+#endif
\ No newline at end of file
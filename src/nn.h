@@ -0,0 +1,72 @@
+#ifndef _NN_H
+    #define _NN_H
+
+
+    /*
+        Public interface of `libnn`, for running saved `.nn` networks inside other programs
+
+        An `NNModel` holds a network's weights, and is never modified after loading, so any number of threads may share one
+        An `NNContext` holds the buffers for running samples through one model, and must only be used by one thread at a time;
+        give each thread its own
+    */
+
+    #include <stddef.h>
+
+    #if defined(_WIN32) && defined(NN_BUILDING_LIBRARY)
+        #define NN_API __declspec(dllexport)
+    #elif defined(_WIN32)
+        #define NN_API __declspec(dllimport)
+    #elif defined(__GNUC__)
+        #define NN_API __attribute__((visibility("default")))
+    #else
+        #define NN_API
+    #endif
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    // Opaque; see `libnn.c`
+    typedef struct NNModel NNModel;
+    typedef struct NNContext NNContext;
+
+    // Loads a network saved by `cnn` (or any other tool) in any `.nn` format: dense, sparse or bfloat16, with or without
+    // conv/pool layers; returns NULL on failure
+    // Free with `NNFreeModel()` once every context made from it has been freed
+    NN_API NNModel *NNLoadModel(const char *filename);
+
+    // Safe to call with NULL
+    NN_API void NNFreeModel(NNModel *model);
+
+    // Pixels per sample, one byte each (same layout as an IDX3 image)
+    NN_API size_t NNModelInputSize(const NNModel *model);
+
+    // Scores per sample (the output layer)
+    NN_API size_t NNModelOutputSize(const NNModel *model);
+
+    // Returns NULL on failure
+    // `max_batch` is the most samples run through the network at once; larger batches passed to `NNPredictBatch()` are split
+    NN_API NNContext *NNCreateContext(const NNModel *model, size_t max_batch);
+
+    // Safe to call with NULL
+    NN_API void NNFreeContext(NNContext *ctx);
+
+    // Splits each layer of single-sample predictions across `threads` threads (including the calling one), cutting their latency
+    // on wide networks; 1 (the default) runs serially. Returns 0 on success, 1 on failure (leaving the context as it was)
+    NN_API int NNSetContextThreads(NNContext *ctx, size_t threads);
+
+    // Runs one sample of `NNModelInputSize()` pixels, returning the predicted class
+    // `scores` receives the `NNModelOutputSize()` output neurons, unless NULL
+    NN_API size_t NNPredict(NNContext *ctx, const unsigned char *pixels, double *scores);
+
+    // Runs `count` samples, stored one after another in `pixels`
+    // `predictions` receives `count` classes and `scores` receives `count * NNModelOutputSize()` output neurons, unless either is NULL
+    // NOTE: batches are summed in a different order to single samples, so scores may differ from `NNPredict()`'s in the last bits
+    NN_API void NNPredictBatch(NNContext *ctx, size_t count, const unsigned char *pixels, size_t *predictions, double *scores);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+
+#endif
\ No newline at end of file
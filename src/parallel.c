@@ -0,0 +1,185 @@
+#include "main.h"
+
+/*
+    Parallel training benchmark: times one epoch of batched training of a deep, narrow dense network serially (`TrainEpoch()`),
+    data-parallel and pipelined (see `pipeline.c`) across several thread counts, and checks each ends with the serial weights
+
+    The network is randomly initialised and fed random pixels and labels, so no datasets are needed
+*/
+
+#define DEFAULT_DEPTH 16
+#define DEFAULT_WIDTH 128
+#define DEFAULT_INPUT_SIZE 784
+#define DEFAULT_BATCH 64
+#define DEFAULT_IMAGES 4096
+#define LEARNING_RATE 0.01
+#define MAX_VALUES 16
+#define OUTPUT_SIZE 10
+#define MEBIBYTE (1024.0 * 1024.0)
+
+// Returns the largest absolute difference between `a` and `b`
+static double MaxDifference(size_t length, const double *a, const double *b) {
+    double largest = 0.0;
+    for (size_t i = 0; i < length; i++) {
+        double difference = fabs(a[i] - b[i]);
+        if (difference > largest) largest = difference;
+    }
+    return largest;
+}
+
+static void ResetNetwork(Network *net, const double *weights, const double *biases) {
+    memcpy(net->all_weights, weights, net->total_weight_count * sizeof(double));
+    memcpy(net->all_biases, biases, net->total_neuron_count * sizeof(double));
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\t--threads LIST         comma-separated thread counts (default 2, 4, ... up to the core count, and at least 2)\n"
+        "\t--depth N              hidden layers (default %d)\n"
+        "\t--width N              hidden layer width (default %d)\n"
+        "\t--input N              input layer size (default %d)\n"
+        "\t--batch N              samples per step of gradient descent (default %d)\n"
+        "\t--micro-batches N      micro-batches per batch when pipelined (default 4 per stage)\n"
+        "\t--images N             samples in the epoch (default %d)\n",
+        program, DEFAULT_DEPTH, DEFAULT_WIDTH, DEFAULT_INPUT_SIZE, DEFAULT_BATCH, DEFAULT_IMAGES);
+}
+
+int main(int argc, char **argv) {
+    size_t threadCounts[MAX_VALUES];
+    size_t threadCountCount = 0;
+    size_t depth = DEFAULT_DEPTH;
+    size_t width = DEFAULT_WIDTH;
+    size_t inputSize = DEFAULT_INPUT_SIZE;
+    size_t batchSize = DEFAULT_BATCH;
+    size_t microBatches = 0; // 0 for 4 per stage
+    size_t imageCount = DEFAULT_IMAGES;
+    for (int i = 1; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--threads") == 0) {
+            valid = ParseSizeList(argv[++i], 1, threadCounts, MAX_VALUES, &threadCountCount);
+        } else if (valid && strcmp(argv[i], "--depth") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &depth);
+        } else if (valid && strcmp(argv[i], "--width") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &width);
+        } else if (valid && strcmp(argv[i], "--input") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &inputSize);
+        } else if (valid && strcmp(argv[i], "--batch") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &batchSize);
+        } else if (valid && strcmp(argv[i], "--micro-batches") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &microBatches);
+        } else if (valid && strcmp(argv[i], "--images") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &imageCount);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (threadCountCount == 0) {
+        size_t cores = GetCoreCount();
+        for (size_t threads = 2; threads < cores && threadCountCount < MAX_VALUES - 1; threads *= 2) threadCounts[threadCountCount++] = threads;
+        threadCounts[threadCountCount++] = cores > 2 ? cores : 2;
+    }
+
+    int returnValue = 0;
+    size_t *layer_lengths = malloc((depth + 1) * sizeof(size_t));
+    char *pixels = malloc(imageCount * inputSize);
+    char **images = malloc(imageCount * sizeof(char *));
+    char *labels = malloc(imageCount);
+    Network network = { 0 };
+    TrainingScratch training = { 0 };
+    ParallelTrainer trainer = { 0 };
+    double *initialWeights = NULL;
+    double *initialBiases = NULL;
+    double *serialWeights = NULL;
+    if (layer_lengths == NULL || pixels == NULL || images == NULL || labels == NULL) {
+        fprintf(stderr, "Failed to allocate memory on the heap.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    for (size_t i = 0; i < depth; i++) layer_lengths[i] = width;
+    layer_lengths[depth] = OUTPUT_SIZE;
+    if (AllocNetwork(&network, inputSize, depth + 1, layer_lengths) || AllocTrainingScratch(&training, &network, batchSize, 0)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for the network.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    initialWeights = malloc(network.total_weight_count * sizeof(double));
+    initialBiases = malloc(network.total_neuron_count * sizeof(double));
+    serialWeights = malloc(network.total_weight_count * sizeof(double));
+    if (initialWeights == NULL || initialBiases == NULL || serialWeights == NULL) {
+        fprintf(stderr, "Failed to allocate memory on the heap.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    srand(1);
+    for (size_t i = 0; i < imageCount * inputSize; i++) pixels[i] = (char)(rand() % 256);
+    for (size_t i = 0; i < imageCount; i++) {
+        images[i] = &pixels[i * inputSize];
+        labels[i] = (char)(rand() % OUTPUT_SIZE);
+    }
+    InitialiseNetwork(&network);
+    memcpy(initialWeights, network.all_weights, network.total_weight_count * sizeof(double));
+    memcpy(initialBiases, network.all_biases, network.total_neuron_count * sizeof(double));
+
+    printf("One epoch of %zu samples through a %zu-input network with %zu hidden layers of %zu and %zu outputs, in batches of %zu, on %zu cores\n\n",
+        imageCount, inputSize, depth, width, (size_t)OUTPUT_SIZE, batchSize, GetCoreCount());
+    printf("| Mode          | Threads | Micro-batch | Time (ms) | Samples/s | Speedup | Max weight diff | Memory (MiB) |\n");
+    printf("| ------------- | ------- | ----------- | --------- | --------- | ------- | --------------- | ------------ |\n");
+    fflush(stdout);
+
+    double start = GetMonotonicTime();
+    TrainEpoch(&network, &training, imageCount, images, labels, LEARNING_RATE);
+    double serialTime = GetMonotonicTime() - start;
+    memcpy(serialWeights, network.all_weights, network.total_weight_count * sizeof(double));
+    printf("| %-13s | %7d | %11zu | %9.1f | %9.0f | %6.2fx | %15.3g | %12.2f |\n", "serial", 1, batchSize, serialTime * 1e3, (double)imageCount / serialTime,
+        1.0, 0.0, (double)training.bytes / MEBIBYTE);
+    fflush(stdout);
+
+    for (size_t t = 0; t < threadCountCount; t++) {
+        for (int mode = DATA_PARALLEL; mode >= PIPELINE_PARALLEL; mode--) {
+            const char *name = mode == DATA_PARALLEL ? "data-parallel" : "pipelined";
+            size_t micros = microBatches > 0 ? microBatches : 4 * threadCounts[t];
+            FreeParallelTrainer(&trainer);
+            if (mode == PIPELINE_PARALLEL && threadCounts[t] > network.layers_count) {
+                printf("| %-13s | %7zu | %11s | more stages than the network's %zu layers |\n", name, threadCounts[t], "-", network.layers_count);
+                continue;
+            }
+            if (AllocParallelTrainer(&trainer, &network, (ParallelMode)mode, threadCounts[t], batchSize, micros)) {
+                fprintf(stderr, "Failed to allocate memory on the heap for %zu %s threads.\n", threadCounts[t], name);
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+            trainer.tiles = training.forward.tiles;
+            ResetNetwork(&network, initialWeights, initialBiases);
+            start = GetMonotonicTime();
+            if (TrainEpochParallel(&network, &trainer, imageCount, images, labels, LEARNING_RATE)) {
+                fprintf(stderr, "Failed to start %zu %s threads.\n", threadCounts[t], name);
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+            double time = GetMonotonicTime() - start;
+            // the gradients are summed in a different order, so the weights only match up to rounding
+            printf("| %-13s | %7zu | %11zu | %9.1f | %9.0f | %6.2fx | %15.3g | %12.2f |\n", name, threadCounts[t], trainer.micro_batch, time * 1e3, (double)imageCount / time,
+                serialTime / time, MaxDifference(network.total_weight_count, network.all_weights, serialWeights), (double)trainer.bytes / MEBIBYTE);
+            fflush(stdout);
+        }
+    }
+
+    CleanupLabel:
+
+    FreeParallelTrainer(&trainer);
+    FreeTrainingScratch(&training);
+    FreeNetwork(&network);
+    free(serialWeights);
+    free(initialBiases);
+    free(initialWeights);
+    free(labels);
+    free(images);
+    free(pixels);
+    free(layer_lengths);
+    return returnValue;
+}
\ No newline at end of file
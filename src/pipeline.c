@@ -0,0 +1,510 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L // for `sched_yield()`
+#endif
+#include "main.h"
+#ifdef NN_USE_THREADS
+    #include <pthread.h>
+    #include <sched.h>
+    #include <stdatomic.h>
+#endif
+
+/*
+    Contains training of dense networks across threads, either pipelined (model-parallel) or data-parallel
+
+    Pipelined, each thread is a stage owning a contiguous group of layers, balanced by weights, and only ever touches those
+    layers' weights, so they stay in its core's cache. Each batch is split into micro-batches, which flow forward from stage to
+    stage and their jacobians back through bounded single-producer single-consumer lock-free queues. Stages follow the 1F1B
+    schedule: after starting just enough micro-batches to fill the pipeline, each stage alternates one forward with one
+    backward, so stage `s` of `S` holds at most `S - s` micro-batches' neurons at once
+
+    Data-parallel, each thread runs its share of every batch through every layer
+
+    Either way, gradients are summed into per-thread buffers and applied once the whole batch is done, so training is the
+    same as `TrainEpoch()` with that batch size (up to rounding) whatever the thread count
+    Both run on the fp64 weights, rounding them into `Network.bf16_weights` (if built) after each batch
+
+    Built without `NN_USE_THREADS`, the threads' work is run in turn on the calling thread, with the pipeline following the
+    GPipe schedule (every micro-batch forwards, then every micro-batch backwards) so no stage waits on another
+*/
+
+#define SPINS_PER_YIELD 64 // so waiting threads don't starve the ones they're waiting on, on an oversubscribed machine
+
+#ifdef NN_USE_THREADS
+    typedef atomic_size_t QueueIndex;
+    #define LoadIndex(index) atomic_load_explicit(&(index), memory_order_acquire)
+    #define StoreIndex(index, value) atomic_store_explicit(&(index), (value), memory_order_release)
+#else
+    typedef size_t QueueIndex;
+    #define LoadIndex(index) (index)
+    #define StoreIndex(index, value) ((index) = (value))
+#endif
+
+// Bounded single-producer single-consumer queue of micro-batches of one layer's neurons or jacobians
+struct TrainerQueue {
+    size_t capacity; // items
+    size_t item_length; // doubles per item
+    double *items;
+    QueueIndex head; // items taken, only written by the consumer
+    char padding[64]; // keeps `head` and `tail` on their own cache lines
+    QueueIndex tail; // items added, only written by the producer
+};
+
+// One thread's layers, buffers and summed gradients
+struct TrainerWorker {
+    size_t first_layer;
+    size_t last_layer; // exclusive
+    size_t capacity; // samples per micro-batch
+    size_t slot_count; // micro-batches whose neurons can be held at once
+    size_t slot_length; // doubles per slot: the input, then each layer's activated neurons, `capacity` samples each
+    size_t *offsets; // per layer of the worker, of its neurons in a slot
+    double *slots;
+    double *jacobians[2]; // swapped each layer
+    double *intended_output;
+    double *weight_steps; // negative gradient times step size, summed over the batch; for the worker's layers only
+    double *bias_steps;
+};
+
+typedef struct SpinBarrier {
+#ifdef NN_USE_THREADS
+    atomic_size_t arrived;
+    atomic_size_t generation;
+#endif
+    size_t count;
+} SpinBarrier;
+
+// Shared by every thread for an epoch
+typedef struct EpochContext {
+    Network *net;
+    ParallelTrainer *trainer;
+    size_t count;
+    char **images;
+    char *labels;
+    double learningRate;
+    SpinBarrier barrier; // data-parallel only
+#ifdef NN_USE_THREADS
+    atomic_int start; // 0 until every thread has been started, then 1 to go, or -1 if one couldn't be
+#endif
+} EpochContext;
+
+#ifdef NN_USE_THREADS
+typedef struct WorkerArgs {
+    EpochContext *ctx;
+    size_t worker;
+} WorkerArgs;
+#endif
+
+static void Spin(size_t *spins) {
+#ifdef NN_USE_THREADS
+    if (++*spins % SPINS_PER_YIELD == 0) (void)sched_yield();
+#else
+    (void)spins;
+#endif
+}
+
+// Copies `length` doubles from `data` onto the back of `queue`, waiting for room if it's full
+static void QueuePush(TrainerQueue *queue, const double *data, size_t length) {
+    size_t tail = LoadIndex(queue->tail);
+    for (size_t spins = 0; tail - LoadIndex(queue->head) == queue->capacity;) Spin(&spins);
+    memcpy(&queue->items[(tail % queue->capacity) * queue->item_length], data, length * sizeof(double));
+    StoreIndex(queue->tail, tail + 1);
+}
+
+// Copies `length` doubles from the front of `queue` into `data`, waiting for an item if it's empty
+static void QueuePop(TrainerQueue *queue, double *data, size_t length) {
+    size_t head = LoadIndex(queue->head);
+    for (size_t spins = 0; LoadIndex(queue->tail) == head;) Spin(&spins);
+    memcpy(data, &queue->items[(head % queue->capacity) * queue->item_length], length * sizeof(double));
+    StoreIndex(queue->head, head + 1);
+}
+
+#ifdef NN_USE_THREADS
+static void WaitBarrier(SpinBarrier *barrier) {
+    size_t generation = atomic_load(&barrier->generation);
+    if (atomic_fetch_add(&barrier->arrived, 1) + 1 == barrier->count) {
+        atomic_store(&barrier->arrived, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+        return;
+    }
+    for (size_t spins = 0; atomic_load(&barrier->generation) == generation;) Spin(&spins);
+}
+#endif
+
+static size_t LayerWidth(const Network *net, size_t layer) {
+    return layer == 0 ? net->dense_input_size : net->layer_lengths[layer - 1];
+}
+
+// Runs `n` samples from `worker`'s slot `slot` (whose input must be loaded) through its layers
+static void WorkerForward(const Network *net, const ParallelTrainer *trainer, TrainerWorker *worker, size_t n, size_t slot) {
+    double *neurons = &worker->slots[slot * worker->slot_length];
+    for (size_t layer = worker->first_layer; layer < worker->last_layer; layer++) {
+        size_t index = layer - worker->first_layer;
+        size_t length = net->layer_lengths[layer];
+        double *prevLayer = &neurons[worker->offsets[index]];
+        double *activated = &neurons[worker->offsets[index + 1]];
+        TransformBatch(LayerWidth(net, layer), length, n, net->weights[layer], prevLayer, activated, trainer->tiles.forward);
+        for (size_t b = 0; b < n; b++) AddVector(length, &activated[b * length], net->biases[layer]);
+        // activated in place; the ReLU derivative is found from the activated neurons, like in `TrainEpoch()`
+        // the last layer uses a different activation function
+        if (layer == net->layers_count - 1) {
+            ActivateOutputVector(n * length, activated, activated);
+        } else {
+            ActivateVector(n * length, activated, activated);
+        }
+    }
+}
+
+// Propagates `n` samples' jacobians (in `worker->jacobians[0]`, for its last layer) back through `worker`'s layers from slot `slot`,
+// adding their steps to the worker's gradient buffers; the jacobian for its input is left in the returned buffer
+static double *WorkerBackward(const Network *net, const ParallelTrainer *trainer, TrainerWorker *worker, size_t n, size_t slot, double stepSize) {
+    double *neurons = &worker->slots[slot * worker->slot_length];
+    double *jacobians = worker->jacobians[0];
+    double *prevJacobians = worker->jacobians[1];
+    double *weights0 = net->weights[worker->first_layer];
+    double *biases0 = net->biases[worker->first_layer];
+    for (size_t layer = worker->last_layer; layer-- > worker->first_layer;) {
+        size_t index = layer - worker->first_layer;
+        size_t length = net->layer_lengths[layer];
+        size_t prevLength = LayerWidth(net, layer);
+        double *prevLayer = &neurons[worker->offsets[index]];
+        // gradients aren't applied until the batch is done, so these are the same weights the forward pass used
+        if (layer > 0) {
+            TransformBatchTransposed(prevLength, length, n, net->weights[layer], jacobians, prevJacobians, trainer->tiles.backward);
+            for (size_t i = 0; i < n * prevLength; i++) {
+                if (prevLayer[i] <= 0.0) prevJacobians[i] = 0.0;
+            }
+        }
+        DescendBatch(prevLength, length, n, prevLayer, &worker->weight_steps[net->weights[layer] - weights0], &worker->bias_steps[net->biases[layer] - biases0], jacobians,
+            stepSize, net->masks == NULL ? NULL : net->masks[layer], trainer->tiles.update);
+        double *swap = jacobians;
+        jacobians = prevJacobians;
+        prevJacobians = swap;
+    }
+    return jacobians;
+}
+
+// Finds the jacobians of `n` samples' output layer from slot `slot` of the last stage (or of a replica) against `labels`
+static void OutputJacobians(const Network *net, TrainerWorker *worker, size_t n, size_t slot, const char *labels) {
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    double *outputs = &worker->slots[(slot * worker->slot_length) + worker->offsets[worker->last_layer - worker->first_layer]];
+    for (size_t b = 0; b < n; b++) {
+        (void)memset(worker->intended_output, 0, output_size * sizeof(double));
+        worker->intended_output[(unsigned char)labels[b]] = 1.0;
+        CostPrimeWrtDeactivated(output_size, &worker->jacobians[0][b * output_size], &outputs[b * output_size], worker->intended_output);
+    }
+}
+
+// Adds `worker`'s summed steps to the weights and biases of its layers, and clears them
+static void ApplyWorkerSteps(Network *net, TrainerWorker *worker) {
+    size_t first = worker->first_layer;
+    size_t last = worker->last_layer - 1;
+    size_t weightCount = (size_t)(net->weights[last] - net->weights[first]) + (LayerWidth(net, last) * net->layer_lengths[last]);
+    size_t biasCount = (size_t)(net->biases[last] - net->biases[first]) + net->layer_lengths[last];
+    AddVector(weightCount, net->weights[first], worker->weight_steps);
+    if (net->bf16_weights != NULL) NarrowToBf16(weightCount, net->weights[first], net->bf16_weights[first]);
+    AddVector(biasCount, net->biases[first], worker->bias_steps);
+    (void)memset(worker->weight_steps, 0, weightCount * sizeof(double));
+    (void)memset(worker->bias_steps, 0, biasCount * sizeof(double));
+}
+
+/* PIPELINE */
+
+// Runs micro-batch `micro` of the batch starting at `begin` (of `batch` samples) forwards through stage `stage`
+static void StageForward(EpochContext *ctx, size_t stage, size_t begin, size_t batch, size_t micro) {
+    Network *net = ctx->net;
+    ParallelTrainer *trainer = ctx->trainer;
+    TrainerWorker *worker = &trainer->workers[stage];
+    size_t start = begin + (micro * trainer->micro_batch);
+    size_t n = batch - (micro * trainer->micro_batch) < trainer->micro_batch ? batch - (micro * trainer->micro_batch) : trainer->micro_batch;
+    size_t slot = micro % worker->slot_count;
+    double *input = &worker->slots[slot * worker->slot_length];
+    if (stage == 0) {
+        LoadInputs(n, net->input_size, &ctx->images[start], input);
+    } else {
+        QueuePop(&trainer->queues[2 * (stage - 1)], input, n * LayerWidth(net, worker->first_layer));
+    }
+    WorkerForward(net, trainer, worker, n, slot);
+    if (stage < trainer->thread_count - 1) {
+        size_t length = net->layer_lengths[worker->last_layer - 1];
+        QueuePush(&trainer->queues[2 * stage], &input[worker->offsets[worker->last_layer - worker->first_layer]], n * length);
+    }
+}
+
+// Runs micro-batch `micro` of the batch starting at `begin` (of `batch` samples) backwards through stage `stage`
+static void StageBackward(EpochContext *ctx, size_t stage, size_t begin, size_t batch, size_t micro) {
+    Network *net = ctx->net;
+    ParallelTrainer *trainer = ctx->trainer;
+    TrainerWorker *worker = &trainer->workers[stage];
+    size_t start = begin + (micro * trainer->micro_batch);
+    size_t n = batch - (micro * trainer->micro_batch) < trainer->micro_batch ? batch - (micro * trainer->micro_batch) : trainer->micro_batch;
+    size_t slot = micro % worker->slot_count;
+    if (stage == trainer->thread_count - 1) {
+        OutputJacobians(net, worker, n, slot, &ctx->labels[start]);
+    } else {
+        QueuePop(&trainer->queues[(2 * stage) + 1], worker->jacobians[0], n * net->layer_lengths[worker->last_layer - 1]);
+    }
+    double *inputJacobians = WorkerBackward(net, trainer, worker, n, slot, ctx->learningRate / (double)batch);
+    if (stage > 0) QueuePush(&trainer->queues[(2 * (stage - 1)) + 1], inputJacobians, n * LayerWidth(net, worker->first_layer));
+}
+
+#ifdef NN_USE_THREADS
+// Runs every batch of the epoch through stage `stage`, following the 1F1B schedule
+static void RunStage(EpochContext *ctx, size_t stage) {
+    ParallelTrainer *trainer = ctx->trainer;
+    size_t stages = trainer->thread_count;
+    for (size_t begin = 0; begin < ctx->count; begin += trainer->batch_size) {
+        size_t batch = ctx->count - begin < trainer->batch_size ? ctx->count - begin : trainer->batch_size;
+        size_t micros = (batch + trainer->micro_batch - 1) / trainer->micro_batch;
+        // enough forwards to fill the pipeline from this stage on, then one forward per backward, then the backwards left
+        size_t warmup = stages - stage - 1 < micros ? stages - stage - 1 : micros;
+        for (size_t micro = 0; micro < warmup; micro++) StageForward(ctx, stage, begin, batch, micro);
+        for (size_t micro = 0; micro < micros; micro++) {
+            if (micro + warmup < micros) StageForward(ctx, stage, begin, batch, micro + warmup);
+            StageBackward(ctx, stage, begin, batch, micro);
+        }
+        ApplyWorkerSteps(ctx->net, &trainer->workers[stage]);
+    }
+}
+#endif
+
+/* DATA-PARALLEL */
+
+// Runs replica `replica`'s share of the batch starting at `begin` (of `batch` samples) forwards and backwards
+static void RunReplica(EpochContext *ctx, size_t replica, size_t begin, size_t batch) {
+    ParallelTrainer *trainer = ctx->trainer;
+    TrainerWorker *worker = &trainer->workers[replica];
+    size_t shareBegin = replica * trainer->micro_batch < batch ? replica * trainer->micro_batch : batch;
+    size_t shareEnd = shareBegin + trainer->micro_batch < batch ? shareBegin + trainer->micro_batch : batch;
+    if (shareBegin == shareEnd) return;
+    size_t n = shareEnd - shareBegin;
+    LoadInputs(n, ctx->net->input_size, &ctx->images[begin + shareBegin], worker->slots);
+    WorkerForward(ctx->net, trainer, worker, n, 0);
+    OutputJacobians(ctx->net, worker, n, 0, &ctx->labels[begin + shareBegin]);
+    (void)WorkerBackward(ctx->net, trainer, worker, n, 0, ctx->learningRate / (double)batch);
+}
+
+// Adds every replica's steps for part `part` of the weights and biases (split evenly between the replicas) to the network, in replica order
+static void ReduceReplicas(EpochContext *ctx, size_t part) {
+    Network *net = ctx->net;
+    ParallelTrainer *trainer = ctx->trainer;
+    size_t parts = trainer->thread_count;
+    size_t weightsBegin = net->total_weight_count * part / parts;
+    size_t weightsEnd = net->total_weight_count * (part + 1) / parts;
+    size_t biasesBegin = net->total_neuron_count * part / parts;
+    size_t biasesEnd = net->total_neuron_count * (part + 1) / parts;
+    for (size_t r = 0; r < parts; r++) {
+        TrainerWorker *worker = &trainer->workers[r];
+        AddVector(weightsEnd - weightsBegin, &net->all_weights[weightsBegin], &worker->weight_steps[weightsBegin]);
+        AddVector(biasesEnd - biasesBegin, &net->all_biases[biasesBegin], &worker->bias_steps[biasesBegin]);
+        (void)memset(&worker->weight_steps[weightsBegin], 0, (weightsEnd - weightsBegin) * sizeof(double));
+        (void)memset(&worker->bias_steps[biasesBegin], 0, (biasesEnd - biasesBegin) * sizeof(double));
+    }
+    if (net->bf16_weights != NULL) NarrowToBf16(weightsEnd - weightsBegin, &net->all_weights[weightsBegin], &net->all_bf16_weights[weightsBegin]);
+}
+
+#ifdef NN_USE_THREADS
+// Runs replica `replica` for every batch of the epoch, reducing its part of the weights between batches
+static void RunReplicaEpoch(EpochContext *ctx, size_t replica) {
+    ParallelTrainer *trainer = ctx->trainer;
+    for (size_t begin = 0; begin < ctx->count; begin += trainer->batch_size) {
+        size_t batch = ctx->count - begin < trainer->batch_size ? ctx->count - begin : trainer->batch_size;
+        RunReplica(ctx, replica, begin, batch);
+        WaitBarrier(&ctx->barrier);
+        ReduceReplicas(ctx, replica);
+        WaitBarrier(&ctx->barrier);
+    }
+}
+
+static void *WorkerThread(void *arg) {
+    WorkerArgs *args = arg;
+    // each thread waits on the others, so none may begin until all have been started
+    for (size_t spins = 0; atomic_load(&args->ctx->start) == 0;) Spin(&spins);
+    if (atomic_load(&args->ctx->start) < 0) return NULL;
+    if (args->ctx->trainer->mode == PIPELINE_PARALLEL) {
+        RunStage(args->ctx, args->worker);
+    } else {
+        RunReplicaEpoch(args->ctx, args->worker);
+    }
+    return NULL;
+}
+#endif
+
+/* ALLOCATION AND TRAINING */
+
+// Splits the dense layers into `stages` contiguous groups of about the same number of weights, each at least one layer
+static void SplitLayers(const Network *net, TrainerWorker *workers, size_t stages) {
+    size_t remaining = net->total_weight_count;
+    size_t layer = 0;
+    for (size_t s = 0; s < stages; s++) {
+        size_t target = remaining / (stages - s);
+        size_t taken = 0;
+        workers[s].first_layer = layer;
+        do {
+            taken += LayerWidth(net, layer) * net->layer_lengths[layer];
+            layer++;
+        } while (layer < net->layers_count - (stages - s - 1) && (s == stages - 1 || taken + (LayerWidth(net, layer) * net->layer_lengths[layer] / 2) <= target));
+        workers[s].last_layer = layer;
+        remaining -= taken;
+    }
+}
+
+// Returns 0 on success, 1 on failure (including more stages than dense layers, or conv/pool layers, which aren't supported)
+// `thread_count` is the number of stages or replicas; pipelined, each batch is split into up to `micro_batches` micro-batches
+int AllocParallelTrainer(ParallelTrainer *trainer, const Network *net, ParallelMode mode, size_t thread_count, size_t batch_size, size_t micro_batches) {
+    memset(trainer, 0, sizeof(*trainer));
+    if (thread_count == 0 || batch_size == 0 || micro_batches == 0 || net->conv_count > 0) return 1;
+    if (mode == PIPELINE_PARALLEL && thread_count > net->layers_count) return 1;
+    trainer->mode = mode;
+    trainer->thread_count = thread_count;
+    trainer->batch_size = batch_size;
+    size_t parts = mode == PIPELINE_PARALLEL ? (micro_batches < batch_size ? micro_batches : batch_size) : thread_count;
+    trainer->micro_batch = (batch_size + parts - 1) / parts;
+    size_t micros = (batch_size + trainer->micro_batch - 1) / trainer->micro_batch;
+    trainer->workers = calloc(thread_count, sizeof(TrainerWorker));
+    if (mode == PIPELINE_PARALLEL && thread_count > 1) trainer->queues = calloc(2 * (thread_count - 1), sizeof(TrainerQueue));
+    if (trainer->workers == NULL || (mode == PIPELINE_PARALLEL && thread_count > 1 && trainer->queues == NULL)) goto AllocFailLabel;
+
+    if (mode == PIPELINE_PARALLEL) {
+        SplitLayers(net, trainer->workers, thread_count);
+    } else {
+        for (size_t t = 0; t < thread_count; t++) trainer->workers[t].last_layer = net->layers_count;
+    }
+    for (size_t t = 0; t < thread_count; t++) {
+        TrainerWorker *worker = &trainer->workers[t];
+        size_t layers = worker->last_layer - worker->first_layer;
+        size_t last = worker->last_layer - 1;
+        worker->capacity = trainer->micro_batch;
+#ifdef NN_USE_THREADS
+        // 1F1B holds at most this many micro-batches on stage `t`
+        worker->slot_count = mode == PIPELINE_PARALLEL && thread_count - t < micros ? thread_count - t : micros;
+#else
+        worker->slot_count = micros;
+#endif
+        if (mode == DATA_PARALLEL) worker->slot_count = 1;
+        worker->offsets = malloc((layers + 1) * sizeof(size_t));
+        if (worker->offsets == NULL) goto AllocFailLabel;
+        size_t longest = LayerWidth(net, worker->first_layer);
+        worker->offsets[0] = 0;
+        for (size_t i = 0; i < layers; i++) {
+            size_t width = i == 0 ? LayerWidth(net, worker->first_layer) : net->layer_lengths[worker->first_layer + i - 1];
+            worker->offsets[i + 1] = worker->offsets[i] + (worker->capacity * width);
+            if (net->layer_lengths[worker->first_layer + i] > longest) longest = net->layer_lengths[worker->first_layer + i];
+        }
+        worker->slot_length = worker->offsets[layers] + (worker->capacity * net->layer_lengths[last]);
+        size_t weightCount = (size_t)(net->weights[last] - net->weights[worker->first_layer]) + (LayerWidth(net, last) * net->layer_lengths[last]);
+        size_t biasCount = (size_t)(net->biases[last] - net->biases[worker->first_layer]) + net->layer_lengths[last];
+        worker->slots = malloc(worker->slot_count * worker->slot_length * sizeof(double));
+        worker->jacobians[0] = malloc(worker->capacity * longest * sizeof(double));
+        worker->jacobians[1] = malloc(worker->capacity * longest * sizeof(double));
+        worker->intended_output = malloc(net->layer_lengths[net->layers_count - 1] * sizeof(double));
+        worker->weight_steps = calloc(weightCount, sizeof(double));
+        worker->bias_steps = calloc(biasCount, sizeof(double));
+        if (worker->slots == NULL || worker->jacobians[0] == NULL || worker->jacobians[1] == NULL || worker->intended_output == NULL
+            || worker->weight_steps == NULL || worker->bias_steps == NULL) goto AllocFailLabel;
+        trainer->bytes += ((worker->slot_count * worker->slot_length) + (2 * worker->capacity * longest) + net->layer_lengths[net->layers_count - 1]
+            + weightCount + biasCount) * sizeof(double);
+
+        // the queues to the next stage: neurons forwards, and jacobians back
+        if (mode == PIPELINE_PARALLEL && t < thread_count - 1) {
+            for (size_t q = 2 * t; q < (2 * t) + 2; q++) {
+                TrainerQueue *queue = &trainer->queues[q];
+                queue->capacity = worker->slot_count;
+                queue->item_length = worker->capacity * net->layer_lengths[last];
+                queue->items = malloc(queue->capacity * queue->item_length * sizeof(double));
+                if (queue->items == NULL) goto AllocFailLabel;
+                trainer->bytes += queue->capacity * queue->item_length * sizeof(double);
+                StoreIndex(queue->head, 0);
+                StoreIndex(queue->tail, 0);
+            }
+        }
+    }
+    return 0;
+
+    AllocFailLabel:
+    FreeParallelTrainer(trainer);
+    return 1;
+}
+
+// Safe to call on a zeroed or partially allocated `ParallelTrainer`
+void FreeParallelTrainer(ParallelTrainer *trainer) {
+    for (size_t q = 0; trainer->queues != NULL && q < 2 * (trainer->thread_count - 1); q++) free(trainer->queues[q].items);
+    for (size_t t = 0; trainer->workers != NULL && t < trainer->thread_count; t++) {
+        TrainerWorker *worker = &trainer->workers[t];
+        free(worker->bias_steps);
+        free(worker->weight_steps);
+        free(worker->intended_output);
+        free(worker->jacobians[1]);
+        free(worker->jacobians[0]);
+        free(worker->slots);
+        free(worker->offsets);
+    }
+    free(trainer->queues);
+    free(trainer->workers);
+    memset(trainer, 0, sizeof(*trainer));
+}
+
+// Sets `first` and `last` (exclusive) to the dense layers of stage `stage` of a pipelined `trainer`
+void GetStageLayers(const ParallelTrainer *trainer, size_t stage, size_t *first, size_t *last) {
+    *first = trainer->workers[stage].first_layer;
+    *last = trainer->workers[stage].last_layer;
+}
+
+// Returns 0 on success, 1 on failure (leaving `net` as it was)
+// Trains `net` on `count` images with `trainer->batch_size` samples per step, split across `trainer->thread_count` threads
+// Pruned weights (see `Network.masks`) stay pruned
+int TrainEpochParallel(Network *net, ParallelTrainer *trainer, size_t count, char **images, char *labels, double learningRate) {
+    EpochContext ctx = { 0 };
+    ctx.net = net;
+    ctx.trainer = trainer;
+    ctx.count = count;
+    ctx.images = images;
+    ctx.labels = labels;
+    ctx.learningRate = learningRate;
+    ctx.barrier.count = trainer->thread_count;
+#ifdef NN_USE_THREADS
+    atomic_init(&ctx.barrier.arrived, 0);
+    atomic_init(&ctx.barrier.generation, 0);
+    atomic_init(&ctx.start, 0);
+    pthread_t *threads = malloc(trainer->thread_count * sizeof(pthread_t));
+    WorkerArgs *args = malloc(trainer->thread_count * sizeof(WorkerArgs));
+    if (threads == NULL || args == NULL) {
+        free(args);
+        free(threads);
+        return 1;
+    }
+    // every thread must run at once, as each waits on the others; the calling thread is the first
+    size_t started = 1;
+    for (; started < trainer->thread_count; started++) {
+        args[started].ctx = &ctx;
+        args[started].worker = started;
+        if (pthread_create(&threads[started], NULL, WorkerThread, &args[started]) != 0) break;
+    }
+    atomic_store(&ctx.start, started == trainer->thread_count ? 1 : -1);
+    if (started == trainer->thread_count) {
+        args[0].ctx = &ctx;
+        args[0].worker = 0;
+        (void)WorkerThread(&args[0]);
+    }
+    for (size_t t = 1; t < started; t++) (void)pthread_join(threads[t], NULL);
+    free(args);
+    free(threads);
+    if (started < trainer->thread_count) return 1;
+#else
+    for (size_t begin = 0; begin < count; begin += trainer->batch_size) {
+        size_t batch = count - begin < trainer->batch_size ? count - begin : trainer->batch_size;
+        if (trainer->mode == PIPELINE_PARALLEL) {
+            size_t micros = (batch + trainer->micro_batch - 1) / trainer->micro_batch;
+            for (size_t micro = 0; micro < micros; micro++) {
+                for (size_t s = 0; s < trainer->thread_count; s++) StageForward(&ctx, s, begin, batch, micro);
+            }
+            for (size_t micro = 0; micro < micros; micro++) {
+                for (size_t s = trainer->thread_count; s-- > 0;) StageBackward(&ctx, s, begin, batch, micro);
+            }
+            for (size_t s = 0; s < trainer->thread_count; s++) ApplyWorkerSteps(net, &trainer->workers[s]);
+        } else {
+            for (size_t r = 0; r < trainer->thread_count; r++) RunReplica(&ctx, r, begin, batch);
+            for (size_t r = 0; r < trainer->thread_count; r++) ReduceReplicas(&ctx, r);
+        }
+    }
+#endif
+    return 0;
+}
\ No newline at end of file
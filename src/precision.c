@@ -0,0 +1,192 @@
+#include "main.h"
+
+/*
+    Precision report: runs a saved `.nn` network with its weights in fp64 and rounded to bfloat16 (see `bf16.c`), and
+    reports what the bfloat16 weights cost in accuracy and save in size, weight bandwidth and time, for inference and for
+    fine-tuning (mixed precision: bfloat16 weights, stepping an fp64 master copy)
+    Datasets and the learning rate come from the config file, like `cnn`
+*/
+
+#define DEFAULT_EPOCHS 1
+#define DEFAULT_TRAINING_BATCH 64
+#define DEFAULT_TIMING_RUNS 3
+#define TIMING_BATCH_SIZE 64
+
+typedef struct PrecisionResult {
+    double accuracy;
+    double inference; // seconds per pass over the test set
+    double training; // seconds per epoch
+    double tunedAccuracy;
+} PrecisionResult;
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s MODEL.nn [options]\n"
+        "\t--epochs N             fine-tuning epochs in each precision; 0 skips fine-tuning (default %d)\n"
+        "\t--batch N              fine-tuning samples per step of gradient descent (default %d)\n"
+        "\t--learning-rate R      fine-tuning learning rate (default: the config file's)\n"
+        "\t--timing-runs N        timed passes over the test set per measurement; the fastest is kept (default %d)\n"
+        "\t--save FILE            save the network with its weights rounded to bfloat16 (before fine-tuning)\n",
+        program, DEFAULT_EPOCHS, DEFAULT_TRAINING_BATCH, DEFAULT_TIMING_RUNS);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char *modelFilename = argv[1];
+    size_t epochs = DEFAULT_EPOCHS;
+    size_t trainingBatch = DEFAULT_TRAINING_BATCH;
+    size_t timingRuns = DEFAULT_TIMING_RUNS;
+    double learningRate = 0.0;
+    const char *saveFilename = NULL;
+    for (int i = 2; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--epochs") == 0) {
+            valid = ParseSizeArg(argv[++i], 0, &epochs);
+        } else if (valid && strcmp(argv[i], "--batch") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &trainingBatch);
+        } else if (valid && strcmp(argv[i], "--learning-rate") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &learningRate) && learningRate > 0.0;
+        } else if (valid && strcmp(argv[i], "--timing-runs") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &timingRuns);
+        } else if (valid && strcmp(argv[i], "--save") == 0) {
+            saveFilename = argv[++i];
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    char training_images_filename[MAX_PATH] = { 0 };
+    char training_labels_filename[MAX_PATH] = { 0 };
+    char testing_images_filename[MAX_PATH] = { 0 };
+    char testing_labels_filename[MAX_PATH] = { 0 };
+    char **images = NULL;
+    char *labels = NULL;
+    char **test_images = NULL;
+    char *test_labels = NULL;
+    Network network = { 0 };
+    TrainingScratch trainingScratch = { 0 };
+    NetworkScratch batchScratch = { 0 };
+
+    // only the datasets and learning rate are used; the architecture comes from the model
+    if (GetDatasetConfig(CONFIG_FILENAME, training_images_filename, training_labels_filename, testing_images_filename, testing_labels_filename, &learningRate, NULL)) {
+        fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (epochs > 0 && learningRate <= 0.0) {
+        fprintf(stderr, "No learning rate given with --learning-rate or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    if (LoadNetwork(modelFilename, &network)) {
+        fprintf(stderr, "Failed to load network from file \"%s\".\n", modelFilename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    uint32_t image_count, label_count, test_image_count, test_label_count, row_count, col_count;
+    images = GetImages(training_images_filename, &image_count, &row_count, &col_count);
+    labels = GetLabels(training_labels_filename, &label_count);
+    if (epochs > 0 && (images == NULL || labels == NULL || (size_t)row_count * col_count != network.input_size)) {
+        fprintf(stderr, "Failed to retrieve training data matching the network from files \"%s\" and \"%s\".\n", training_images_filename, training_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    test_images = GetImages(testing_images_filename, &test_image_count, &row_count, &col_count);
+    test_labels = GetLabels(testing_labels_filename, &test_label_count);
+    if (test_images == NULL || test_labels == NULL || (size_t)row_count * col_count != network.input_size) {
+        fprintf(stderr, "Failed to retrieve testing data matching the network from files \"%s\" and \"%s\".\n", testing_images_filename, testing_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t trainingCount = images == NULL || labels == NULL ? 0 : image_count < label_count ? image_count : label_count;
+    size_t testingCount = test_image_count < test_label_count ? test_image_count : test_label_count;
+
+    if (saveFilename != NULL) {
+        if (SaveBf16Network(saveFilename, &network)) {
+            fprintf(stderr, "Failed to write to the file \"%s\".\n", saveFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        printf("Saved with bfloat16 weights to \"%s\".\n", saveFilename);
+    }
+
+    printf("Running \"%s\" (%zu weights) with fp64 and bfloat16 weights\n", modelFilename, network.total_weight_count);
+    printf("Inference is per image over %zu test images, %d at a time, with each batch streaming every weight once\n", testingCount, TIMING_BATCH_SIZE);
+    if (epochs > 0) printf("Fine-tuning is %zu epoch%s of %zu images in batches of %zu at learning rate %g, per image\n", epochs, epochs == 1 ? "" : "s", trainingCount, trainingBatch, learningRate);
+    putchar('\n');
+    printf("| Weights  | Size (KiB) | Accuracy | Delta   | Inference (us) | Weights (GB/s) | Speedup | Fine-tuning (us) | Speedup | Tuned accuracy |\n");
+    printf("| -------- | ---------- | -------- | ------- | -------------- | -------------- | ------- | ---------------- | ------- | -------------- |\n");
+    fflush(stdout);
+
+    PrecisionResult results[2] = { { 0 } };
+    for (size_t bf16 = 0; bf16 < 2; bf16++) {
+        // both start from the saved weights; the fp64 run of a network saved as bfloat16 has exactly its weights, widened
+        if (bf16) {
+            FreeNetwork(&network);
+            if (LoadNetwork(modelFilename, &network)) {
+                fprintf(stderr, "Failed to reload network from file \"%s\".\n", modelFilename);
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+        }
+        FreeSparseWeights(&network); // both are timed with dense kernels
+        FreeBf16Weights(&network);
+        if (bf16 && BuildBf16Weights(&network)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for bfloat16 weights.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        // the scratches hold fp32 inputs for the bfloat16 kernels, so are allocated for each
+        FreeTrainingScratch(&trainingScratch);
+        FreeScratch(&batchScratch);
+        if (AllocScratch(&batchScratch, &network, TIMING_BATCH_SIZE) || (epochs > 0 && AllocTrainingScratch(&trainingScratch, &network, trainingBatch, 0))) {
+            fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+
+        PrecisionResult *result = &results[bf16];
+        result->accuracy = (double)Evaluate(&network, &batchScratch, testingCount, test_images, test_labels, NULL) / testingCount;
+        result->inference = TimeInference(&network, &batchScratch, testingCount, test_images, test_labels, timingRuns);
+        if (epochs > 0) {
+            double start = GetMonotonicTime();
+            for (size_t epoch = 0; epoch < epochs; epoch++) TrainEpoch(&network, &trainingScratch, trainingCount, images, labels, learningRate);
+            result->training = (GetMonotonicTime() - start) / epochs;
+            result->tunedAccuracy = (double)Evaluate(&network, &batchScratch, testingCount, test_images, test_labels, NULL) / testingCount;
+        }
+
+        size_t weightBytes = network.total_weight_count * (bf16 ? sizeof(uint16_t) : sizeof(double));
+        size_t size = GetNetworkFileSize(&network, false) - (network.total_weight_count * sizeof(double)) + weightBytes;
+        size_t batches = (testingCount + TIMING_BATCH_SIZE - 1) / TIMING_BATCH_SIZE;
+        printf("| %-8s | %10.1f | %8.4f | %+7.4f | %14.2f | %14.2f | %6.2fx |", bf16 ? "bfloat16" : "fp64", size / 1024.0, result->accuracy, result->accuracy - results[0].accuracy,
+            result->inference / testingCount * 1e6, (double)(weightBytes * batches) / result->inference / 1e9, results[0].inference / result->inference);
+        if (epochs > 0) {
+            printf(" %16.2f | %6.2fx | %14.4f |\n", result->training / trainingCount * 1e6, results[0].training / result->training, result->tunedAccuracy);
+        } else {
+            printf(" %16s | %7s | %14s |\n", "-", "-", "-");
+        }
+        fflush(stdout);
+    }
+
+    CleanupLabel:
+
+    FreeScratch(&batchScratch);
+    FreeTrainingScratch(&trainingScratch);
+    FreeNetwork(&network);
+    free(test_labels);
+    if (test_images != NULL) free(test_images[0]);
+    free(test_images);
+    free(labels);
+    if (images != NULL) free(images[0]);
+    free(images);
+    return returnValue;
+}
\ No newline at end of file
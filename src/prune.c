@@ -0,0 +1,186 @@
+#include "main.h"
+
+/*
+    Pruning report: prunes a saved `.nn` network to several sparsities and reports what each one costs and saves
+
+    For each sparsity, the network is pruned gradually over `--steps` steps with an epoch of fine-tuning after each (masked,
+    so pruned weights stay pruned), then compared against the unpruned network on accuracy, saved size, and inference time
+    with the dense and sparse (CSR) kernels
+    Datasets and the learning rate come from the config file, like `cnn`
+*/
+
+#define DEFAULT_STEPS 4
+#define DEFAULT_TIMING_RUNS 3
+#define TIMING_BATCH_SIZE 64
+#define MAX_LEVELS 16
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s MODEL.nn [options]\n"
+        "\t--levels LIST          comma-separated sparsities to prune to, in percent (default 50,80,90,95)\n"
+        "\t--steps N              pruning steps (each followed by an epoch of fine-tuning) per sparsity (default %d)\n"
+        "\t--learning-rate R      fine-tuning learning rate (default: the config file's)\n"
+        "\t--timing-runs N        timed passes over the test set per measurement; the fastest is kept (default %d)\n"
+        "\t--save PREFIX          save each pruned network sparse, as PREFIX-<sparsity>.nn\n",
+        program, DEFAULT_STEPS, DEFAULT_TIMING_RUNS);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char *modelFilename = argv[1];
+    double levels[MAX_LEVELS] = { 0.50, 0.80, 0.90, 0.95 };
+    size_t levelsCount = 4;
+    size_t steps = DEFAULT_STEPS;
+    size_t timingRuns = DEFAULT_TIMING_RUNS;
+    double learningRate = 0.0;
+    const char *savePrefix = NULL;
+    for (int i = 2; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--levels") == 0) {
+            valid = ParseNumberList(argv[++i], 0.0, levels, MAX_LEVELS, &levelsCount);
+            for (size_t level = 0; level < levelsCount && valid; level++) {
+                valid = levels[level] < 100.0;
+                levels[level] /= 100.0;
+            }
+        } else if (valid && strcmp(argv[i], "--steps") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &steps);
+        } else if (valid && strcmp(argv[i], "--learning-rate") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &learningRate) && learningRate > 0.0;
+        } else if (valid && strcmp(argv[i], "--timing-runs") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &timingRuns);
+        } else if (valid && strcmp(argv[i], "--save") == 0) {
+            savePrefix = argv[++i];
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    char training_images_filename[MAX_PATH] = { 0 };
+    char training_labels_filename[MAX_PATH] = { 0 };
+    char testing_images_filename[MAX_PATH] = { 0 };
+    char testing_labels_filename[MAX_PATH] = { 0 };
+    char **images = NULL;
+    char *labels = NULL;
+    char **test_images = NULL;
+    char *test_labels = NULL;
+    Network baseline = { 0 };
+    Network network = { 0 };
+    TrainingScratch trainingScratch = { 0 };
+    NetworkScratch singleScratch = { 0 };
+    NetworkScratch batchScratch = { 0 };
+
+    // only the datasets and learning rate are used; the architecture comes from the model
+    if (GetDatasetConfig(CONFIG_FILENAME, training_images_filename, training_labels_filename, testing_images_filename, testing_labels_filename, &learningRate, NULL)) {
+        fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (learningRate <= 0.0) {
+        fprintf(stderr, "No learning rate given with --learning-rate or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    if (LoadNetwork(modelFilename, &baseline)) {
+        fprintf(stderr, "Failed to load network from file \"%s\".\n", modelFilename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    FreeSparseWeights(&baseline); // the baseline is timed with the dense kernels
+    uint32_t image_count, label_count, test_image_count, test_label_count, row_count, col_count;
+    images = GetImages(training_images_filename, &image_count, &row_count, &col_count);
+    labels = GetLabels(training_labels_filename, &label_count);
+    if (images == NULL || labels == NULL || (size_t)row_count * col_count != baseline.input_size) {
+        fprintf(stderr, "Failed to retrieve training data matching the network from files \"%s\" and \"%s\".\n", training_images_filename, training_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    test_images = GetImages(testing_images_filename, &test_image_count, &row_count, &col_count);
+    test_labels = GetLabels(testing_labels_filename, &test_label_count);
+    if (test_images == NULL || test_labels == NULL || (size_t)row_count * col_count != baseline.input_size) {
+        fprintf(stderr, "Failed to retrieve testing data matching the network from files \"%s\" and \"%s\".\n", testing_images_filename, testing_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t trainingCount = image_count < label_count ? image_count : label_count;
+    size_t testingCount = test_image_count < test_label_count ? test_image_count : test_label_count;
+    if (AllocTrainingScratch(&trainingScratch, &baseline, 1, 0) || AllocScratch(&singleScratch, &baseline, 1) || AllocScratch(&batchScratch, &baseline, TIMING_BATCH_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    size_t baselineRight = Evaluate(&baseline, &batchScratch, testingCount, test_images, test_labels, NULL);
+    double baselineAccuracy = (double)baselineRight / testingCount;
+    double baselineSingle = TimeInference(&baseline, &singleScratch, testingCount, test_images, test_labels, timingRuns);
+    double baselineBatch = TimeInference(&baseline, &batchScratch, testingCount, test_images, test_labels, timingRuns);
+    size_t baselineSize = GetNetworkFileSize(&baseline, false);
+
+    printf("Pruning \"%s\" (%zu weights), fine-tuning %zu steps per sparsity at learning rate %g\n", modelFilename, baseline.total_weight_count, steps, learningRate);
+    printf("Inference time is per image over %zu test images, one at a time (batch 1) and %d at a time (batch %d)\n\n", testingCount, TIMING_BATCH_SIZE, TIMING_BATCH_SIZE);
+    printf("| Sparsity | Accuracy | Delta   | Size (KiB) | Size ratio | Batch 1 (us) | Speedup | Batch %d (us) | Speedup |\n", TIMING_BATCH_SIZE);
+    printf("| -------- | -------- | ------- | ---------- | ---------- | ------------ | ------- | ------------- | ------- |\n");
+    printf("| %7.2f%% | %8.4f | %+7.4f | %10.1f | %9.2fx | %12.2f | %6.2fx | %13.2f | %6.2fx |\n", 0.0, baselineAccuracy, 0.0,
+        baselineSize / 1024.0, 1.0, baselineSingle / testingCount * 1e6, 1.0, baselineBatch / testingCount * 1e6, 1.0);
+    fflush(stdout);
+
+    for (size_t level = 0; level < levelsCount; level++) {
+        // start every level from the unpruned network
+        FreeNetwork(&network);
+        if (LoadNetwork(modelFilename, &network) || AllocMasks(&network)) {
+            fprintf(stderr, "Failed to reload network from file \"%s\".\n", modelFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        FreeSparseWeights(&network);
+        for (size_t step = 1; step <= steps; step++) {
+            PruneNetwork(&network, PruningSchedule(levels[level], step, steps));
+            TrainEpoch(&network, &trainingScratch, trainingCount, images, labels, learningRate);
+        }
+        size_t numRight = Evaluate(&network, &batchScratch, testingCount, test_images, test_labels, NULL);
+        double accuracy = (double)numRight / testingCount;
+        if (BuildSparseWeights(&network)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for sparse weights.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        double single = TimeInference(&network, &singleScratch, testingCount, test_images, test_labels, timingRuns);
+        double batch = TimeInference(&network, &batchScratch, testingCount, test_images, test_labels, timingRuns);
+        size_t size = GetNetworkFileSize(&network, true);
+        printf("| %7.2f%% | %8.4f | %+7.4f | %10.1f | %9.2fx | %12.2f | %6.2fx | %13.2f | %6.2fx |\n", GetSparsity(&network) * 100.0, accuracy, accuracy - baselineAccuracy,
+            size / 1024.0, (double)baselineSize / size, single / testingCount * 1e6, baselineSingle / single, batch / testingCount * 1e6, baselineBatch / batch);
+        fflush(stdout);
+
+        if (savePrefix != NULL) {
+            char saveFilename[MAX_PATH];
+            (void)snprintf(saveFilename, sizeof(saveFilename), "%s-%g.nn", savePrefix, levels[level] * 100.0);
+            if (SaveSparseNetwork(saveFilename, &network)) {
+                fprintf(stderr, "Failed to write to the file \"%s\".\n", saveFilename);
+                returnValue = 1;
+            }
+        }
+    }
+
+    CleanupLabel:
+
+    FreeScratch(&batchScratch);
+    FreeScratch(&singleScratch);
+    FreeTrainingScratch(&trainingScratch);
+    FreeNetwork(&network);
+    FreeNetwork(&baseline);
+    free(test_labels);
+    if (test_images != NULL) free(test_images[0]);
+    free(test_images);
+    free(labels);
+    if (images != NULL) free(images[0]);
+    free(images);
+    return returnValue;
+}
\ No newline at end of file
@@ -0,0 +1,326 @@
+#include "main.h"
+
+/*
+    Offline batch scoring: streams an IDX3 image file through a saved `.nn` network and writes a prediction per image
+
+    Images are read `--chunk` at a time, and each chunk is split into batches of `--batch` images that are run on every
+    core at once, so the whole file never has to fit in memory
+    Scores are the output layer normalised to sum to 1
+*/
+
+#define DEFAULT_BATCH 64
+#define DEFAULT_CHUNK 16384
+#define MAX_PRINTED_CLASSES 32 // larger confusion matrices aren't printed
+
+typedef enum OutputFormat {
+    FORMAT_CSV,
+    FORMAT_BINARY
+} OutputFormat;
+
+typedef struct ScoreContext {
+    const Network *net;
+    NetworkScratch *scratches; // one per worker
+    char **images; // current chunk
+    size_t top_k;
+    size_t *predictions; // one per image in the chunk
+    size_t *top_classes; // `top_k` per image in the chunk, best first
+    double *top_scores; // matches `top_classes`
+} ScoreContext;
+
+// Scores images `[begin, end)` of the current chunk
+static void ScoreTask(void *context, size_t worker, size_t begin, size_t end) {
+    ScoreContext *ctx = context;
+    const Network *net = ctx->net;
+    NetworkScratch *scratch = &ctx->scratches[worker];
+    size_t output_size = net->layer_lengths[net->layers_count - 1];
+    size_t count = end - begin;
+    LoadInputs(count, net->input_size, &ctx->images[begin], scratch->inputs);
+    ForwardPassBatch(net, count, scratch->inputs, scratch);
+    for (size_t b = 0; b < count; b++) {
+        double *output = &scratch->activated_neurons[net->layers_count - 1][b * output_size];
+        ctx->predictions[begin + b] = ArgMax(output_size, output);
+        if (ctx->top_k == 0) continue;
+        double sum = 0.0;
+        for (size_t i = 0; i < output_size; i++) sum += output[i];
+        if (sum <= 0.0) sum = 1.0;
+        // insertion into a list kept sorted best first
+        size_t *classes = &ctx->top_classes[(begin + b) * ctx->top_k];
+        double *scores = &ctx->top_scores[(begin + b) * ctx->top_k];
+        size_t filled = 0;
+        for (size_t i = 0; i < output_size; i++) {
+            double score = output[i] / sum;
+            if (filled == ctx->top_k && score <= scores[filled - 1]) continue;
+            size_t pos = filled < ctx->top_k ? filled++ : filled - 1;
+            while (pos > 0 && scores[pos - 1] < score) {
+                classes[pos] = classes[pos - 1];
+                scores[pos] = scores[pos - 1];
+                pos--;
+            }
+            classes[pos] = i;
+            scores[pos] = score;
+        }
+    }
+}
+
+// Writes a big-endian `uint32_t`, for IDX headers; returns 0 on success, 1 on failure
+static int WriteBigEndian(FILE *f, uint32_t value) {
+    unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value };
+    return fwrite(bytes, 1, sizeof(bytes), f) != sizeof(bytes);
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s MODEL.nn IMAGES.idx3-ubyte [options]\n"
+        "\t--labels FILE          IDX1 labels for the images, to report accuracy and a confusion matrix\n"
+        "\t--output FILE          where to write predictions (default: none)\n"
+        "\t--format csv|binary    output format (default csv); see README\n"
+        "\t--top-k K              also write the K best classes and their scores per image\n"
+        "\t--threads N            threads to score with (default: one per core)\n"
+        "\t--batch N              images per forward pass (default %d)\n"
+        "\t--chunk N              images read from the file at once (default %d)\n",
+        program, DEFAULT_BATCH, DEFAULT_CHUNK);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char *modelFilename = argv[1];
+    const char *imagesFilename = argv[2];
+    const char *labelsFilename = NULL;
+    const char *outputFilename = NULL;
+    OutputFormat format = FORMAT_CSV;
+    size_t top_k = 0;
+    size_t threadCount = 0;
+    size_t batchSize = DEFAULT_BATCH;
+    size_t chunkSize = DEFAULT_CHUNK;
+    for (int i = 3; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--labels") == 0) {
+            labelsFilename = argv[++i];
+        } else if (valid && strcmp(argv[i], "--output") == 0) {
+            outputFilename = argv[++i];
+        } else if (valid && strcmp(argv[i], "--format") == 0) {
+            i++;
+            if (strcmp(argv[i], "csv") == 0) format = FORMAT_CSV;
+            else if (strcmp(argv[i], "binary") == 0) format = FORMAT_BINARY;
+            else valid = false;
+        } else if (valid && strcmp(argv[i], "--top-k") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &top_k);
+        } else if (valid && strcmp(argv[i], "--threads") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &threadCount);
+        } else if (valid && strcmp(argv[i], "--batch") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &batchSize);
+        } else if (valid && strcmp(argv[i], "--chunk") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &chunkSize);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    Network network = { 0 };
+    ThreadPool *pool = NULL;
+    NetworkScratch *scratches = NULL;
+    size_t scratchCount = 0;
+    FILE *imagesFile = NULL;
+    FILE *outputFile = NULL;
+    char *labels = NULL;
+    char *rawChunk = NULL;
+    char **chunkImages = NULL;
+    size_t *predictions = NULL;
+    size_t *topClasses = NULL;
+    double *topScores = NULL;
+    size_t *confusion = NULL;
+
+    if (LoadNetwork(modelFilename, &network)) {
+        fprintf(stderr, "Failed to load network from file \"%s\".\n", modelFilename);
+        return 1;
+    }
+    size_t output_size = network.layer_lengths[network.layers_count - 1];
+    if (top_k > output_size) top_k = output_size;
+
+    uint32_t image_count, row_count, col_count;
+    imagesFile = OpenImages(imagesFilename, &image_count, &row_count, &col_count);
+    if (imagesFile == NULL) {
+        fprintf(stderr, "Failed to open images file \"%s\".\n", imagesFilename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t input_size = (size_t)row_count * col_count;
+    if (input_size != network.input_size) {
+        fprintf(stderr, "Images are %u x %u, but the network expects %zu pixels.\n", col_count, row_count, network.input_size);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (labelsFilename != NULL) {
+        uint32_t label_count;
+        labels = GetLabels(labelsFilename, &label_count);
+        if (labels == NULL || label_count != image_count) {
+            fprintf(stderr, "Failed to retrieve %u labels from file \"%s\".\n", image_count, labelsFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+    if (outputFilename != NULL) {
+        if (format == FORMAT_BINARY && top_k == 0 && output_size > UCHAR_MAX + 1) {
+            fprintf(stderr, "Binary output without --top-k stores predictions as bytes, which can't hold %zu classes.\n", output_size);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        outputFile = fopen(outputFilename, format == FORMAT_BINARY ? "wb" : "w");
+        if (outputFile == NULL) {
+            fprintf(stderr, "Failed to open output file \"%s\".\n", outputFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+
+    pool = CreateThreadPool(threadCount);
+    if (pool == NULL) {
+        fprintf(stderr, "Failed to start threads.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (chunkSize > image_count) chunkSize = image_count > 0 ? image_count : 1;
+    scratches = calloc(ThreadPoolSize(pool), sizeof(NetworkScratch));
+    rawChunk = malloc(chunkSize * input_size);
+    chunkImages = malloc(chunkSize * sizeof(char*));
+    predictions = malloc(chunkSize * sizeof(size_t));
+    topClasses = malloc((chunkSize * top_k + 1) * sizeof(size_t));
+    topScores = malloc((chunkSize * top_k + 1) * sizeof(double));
+    confusion = calloc(output_size * output_size, sizeof(size_t));
+    if (scratches == NULL || rawChunk == NULL || chunkImages == NULL || predictions == NULL || topClasses == NULL || topScores == NULL || confusion == NULL) {
+        fprintf(stderr, "Failed to allocate memory on the heap for scoring.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    for (; scratchCount < ThreadPoolSize(pool); scratchCount++) {
+        if (AllocScratch(&scratches[scratchCount], &network, batchSize)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+    for (size_t i = 0; i < chunkSize; i++) chunkImages[i] = rawChunk + (i * input_size);
+
+    if (outputFile != NULL) {
+        int failed = 0;
+        if (format == FORMAT_CSV) {
+            failed |= fprintf(outputFile, "index,prediction%s", labels != NULL ? ",label" : "") < 0;
+            for (size_t k = 1; k <= top_k; k++) failed |= fprintf(outputFile, ",class_%zu,score_%zu", k, k) < 0;
+            failed |= fputc('\n', outputFile) == EOF;
+        } else if (top_k == 0) {
+            // an IDX1 file, which can be read back with `GetLabels()`
+            failed |= WriteBigEndian(outputFile, 0x00000801);
+            failed |= WriteBigEndian(outputFile, image_count);
+        }
+        if (failed) {
+            fprintf(stderr, "Failed to write to output file \"%s\".\n", outputFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+    }
+
+    printf("Scoring %u images from \"%s\" with %zu threads...\n", image_count, imagesFilename, ThreadPoolSize(pool));
+    ScoreContext context = { &network, scratches, chunkImages, top_k, predictions, topClasses, topScores };
+    size_t numRight = 0;
+    double computeTime = 0.0;
+    double start = GetMonotonicTime();
+    for (size_t done = 0; done < image_count; ) {
+        size_t count = image_count - done < chunkSize ? image_count - done : chunkSize;
+        if (fread(rawChunk, input_size, count, imagesFile) != count) {
+            fprintf(stderr, "Failed to read images %zu to %zu from file \"%s\".\n", done, done + count - 1, imagesFilename);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        double computeStart = GetMonotonicTime();
+        ParallelFor(pool, count, batchSize, ScoreTask, &context);
+        computeTime += GetMonotonicTime() - computeStart;
+
+        if (labels != NULL) {
+            for (size_t i = 0; i < count; i++) {
+                size_t label = (unsigned char)labels[done + i];
+                if (label == predictions[i]) numRight++;
+                if (label < output_size) confusion[(label * output_size) + predictions[i]]++;
+            }
+        }
+        if (outputFile != NULL) {
+            int failed = 0;
+            for (size_t i = 0; i < count && !failed; i++) {
+                if (format == FORMAT_CSV) {
+                    failed |= fprintf(outputFile, "%zu,%zu", done + i, predictions[i]) < 0;
+                    if (labels != NULL) failed |= fprintf(outputFile, ",%u", (unsigned char)labels[done + i]) < 0;
+                    for (size_t k = 0; k < top_k; k++) failed |= fprintf(outputFile, ",%zu,%.6f", topClasses[(i * top_k) + k], topScores[(i * top_k) + k]) < 0;
+                    failed |= fputc('\n', outputFile) == EOF;
+                } else if (top_k == 0) {
+                    failed |= fputc((int)predictions[i], outputFile) == EOF;
+                } else {
+                    for (size_t k = 0; k < top_k; k++) {
+                        uint32_t cls = (uint32_t)topClasses[(i * top_k) + k];
+                        failed |= fwrite(&cls, sizeof(uint32_t), 1, outputFile) != 1;
+                    }
+                    for (size_t k = 0; k < top_k; k++) {
+                        float score = (float)topScores[(i * top_k) + k];
+                        failed |= fwrite(&score, sizeof(float), 1, outputFile) != 1;
+                    }
+                }
+            }
+            if (failed) {
+                fprintf(stderr, "Failed to write to output file \"%s\".\n", outputFilename);
+                returnValue = 1;
+                goto CleanupLabel;
+            }
+        }
+        done += count;
+    }
+    double elapsed = GetMonotonicTime() - start;
+
+    printf("\tTotal time: %.0fms (%.0f images/s)\n", elapsed * 1e3, elapsed > 0.0 ? image_count / elapsed : 0.0);
+    printf("\tCompute time: %.0fms (%.0f images/s)\n", computeTime * 1e3, computeTime > 0.0 ? image_count / computeTime : 0.0);
+    if (labels != NULL && image_count > 0) {
+        printf("\tAccuracy: %.4f\n", (double)numRight / image_count);
+        if (output_size <= MAX_PRINTED_CLASSES) {
+            printf("\tConfusion matrix (rows are labels, columns are predictions):\n\t     ");
+            for (size_t col = 0; col < output_size; col++) printf(" %6zu", col);
+            putchar('\n');
+            for (size_t row = 0; row < output_size; row++) {
+                printf("\t%4zu ", row);
+                for (size_t col = 0; col < output_size; col++) printf(" %6zu", confusion[(row * output_size) + col]);
+                putchar('\n');
+            }
+        }
+    }
+    if (outputFile != NULL) {
+        int closed = fclose(outputFile);
+        outputFile = NULL;
+        if (closed != 0) {
+            fprintf(stderr, "Failed to finish writing to output file \"%s\".\n", outputFilename);
+            returnValue = 1;
+        } else {
+            printf("Predictions written to \"%s\".\n", outputFilename);
+        }
+    }
+
+    CleanupLabel:
+
+    if (outputFile != NULL) (void)fclose(outputFile);
+    if (imagesFile != NULL) (void)fclose(imagesFile);
+    free(confusion);
+    free(topScores);
+    free(topClasses);
+    free(predictions);
+    free(chunkImages);
+    free(rawChunk);
+    for (size_t i = 0; i < scratchCount; i++) FreeScratch(&scratches[i]);
+    free(scratches);
+    DestroyThreadPool(pool);
+    free(labels);
+    FreeNetwork(&network);
+    return returnValue;
+}
\ No newline at end of file
@@ -0,0 +1,506 @@
+#define _POSIX_C_SOURCE 200809L // for `pthread_condattr_setclock()` and `sigaction()`
+#include "main.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+/*
+    Inference server: loads a saved `.nn` network and answers classification requests over a socket
+
+    Requests from all connections are coalesced into micro-batches, which are run once `--max-batch` requests are queued or
+    the oldest queued request has waited `--max-wait-us` microseconds, whichever comes first
+    Each connection has a reader thread, which queues its requests, and a writer thread, which sends its responses, so a
+    client that stops reading only stalls itself: its reader stops reading once `--max-pending` of its requests are unanswered
+
+    On SIGINT or SIGTERM, the server stops accepting connections and reading requests, answers every request already read,
+    and waits up to `SHUTDOWN_GRACE` seconds for the responses to be sent before closing every connection
+
+    Protocol (all integers and doubles in the server's native endianness):
+        on connect, the server sends `uint64_t input_size, uint64_t output_size`
+        each request is `input_size` bytes of pixels (one `unsigned char` per pixel, same layout as an IDX3 image)
+        each response is `uint64_t prediction` followed by `output_size` doubles (the output layer)
+    Requests may be pipelined; responses on a connection are sent in request order
+*/
+
+#define DEFAULT_ADDRESS "unix:nn.sock"
+#define DEFAULT_MAX_BATCH 32
+#define DEFAULT_MAX_WAIT_US 1000
+#define DEFAULT_MAX_PENDING 64
+#define DEFAULT_STATS_INTERVAL 10.0 // seconds
+#define LATENCY_SAMPLES_CAPACITY (1u << 20)
+#define ACCEPT_POLL_MS 100 // how often the accept thread checks for `stopRequested` and reaps connections
+#define SHUTDOWN_GRACE 1.0 // seconds to wait for the last responses to be sent when stopping
+
+typedef struct Request {
+    struct Request *next; // in `Server.head` until run, then in `Connection.head` until sent
+    struct Connection *conn;
+    double received; // `GetMonotonicTime()` once the request was fully read
+    unsigned char *response; // `response_size` long, after the pixels
+    unsigned char pixels[]; // `input_size` long
+} Request;
+
+// Served by a reader and a writer thread, then joined, closed and freed by `ReapConnections()` once both have stopped
+// `running`, `pending`, `reading`, `head`, `tail` and `next` are protected by `Server.lock`
+typedef struct Connection {
+    struct Connection *next; // in `Server.connections`
+    struct Server *server;
+    int fd;
+    pthread_t reader;
+    pthread_t writer;
+    bool has_reader; // false if the reader thread couldn't be started
+    size_t running; // threads not yet stopped
+    size_t pending; // requests read but not yet sent
+    bool reading; // cleared once the reader thread stops
+    bool broken; // set once a response fails to send; only touched by the writer thread
+    pthread_cond_t changed; // broadcast, as both threads wait on it, whenever a response is queued or sent, or the reader thread stops
+    Request *head; // responses waiting to be sent, in request order
+    Request *tail;
+} Connection;
+
+typedef struct Server {
+    const Network *net;
+    size_t max_batch;
+    size_t max_pending;
+    double max_wait; // seconds
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // signalled whenever a request is queued
+    pthread_cond_t stopped; // broadcast whenever a connection's thread stops
+    Request *head;
+    Request *tail;
+    size_t queue_length;
+    Connection *connections; // every connection not yet reaped
+    LatencyStats *stats; // of every response sent, from being read to being sent
+} Server;
+
+static atomic_int stopRequested = 0; // atomic rather than `sig_atomic_t`, as every thread reads it
+
+static void StopHandler(int signum) {
+    (void)signum;
+    stopRequested = 1;
+}
+
+// Converts seconds from `GetMonotonicTime()` into a deadline for `pthread_cond_timedwait()` on a `CLOCK_MONOTONIC` condition variable
+static struct timespec ToTimespec(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return ts;
+}
+
+// Marks one of `conn`'s threads as stopped
+// `server->lock` must be held
+static void ReleaseConnection(Server *server, Connection *conn) {
+    conn->running--;
+    pthread_cond_broadcast(&server->stopped);
+}
+
+// Joins, closes and frees every connection whose threads have both stopped
+static void ReapConnections(Server *server) {
+    Connection *finished = NULL;
+    pthread_mutex_lock(&server->lock);
+    for (Connection **link = &server->connections; *link != NULL;) {
+        Connection *conn = *link;
+        if (conn->running > 0) {
+            link = &conn->next;
+            continue;
+        }
+        *link = conn->next;
+        conn->next = finished;
+        finished = conn;
+    }
+    pthread_mutex_unlock(&server->lock);
+    while (finished != NULL) {
+        Connection *conn = finished;
+        finished = conn->next;
+        if (conn->has_reader) (void)pthread_join(conn->reader, NULL);
+        (void)pthread_join(conn->writer, NULL);
+        (void)close(conn->fd);
+        pthread_cond_destroy(&conn->changed);
+        free(conn);
+    }
+}
+
+// Reads requests from one connection and queues them until the client disconnects or the server stops
+static void *ReaderThread(void *arg) {
+    Connection *conn = arg;
+    Server *server = conn->server;
+    size_t input_size = server->net->input_size;
+    size_t response_size = sizeof(uint64_t) + server->net->layer_lengths[server->net->layers_count - 1] * sizeof(double);
+    pthread_mutex_lock(&server->lock);
+    while (!stopRequested) {
+        // stop reading while the client has too many requests unanswered, so a client that doesn't read can't fill the queue
+        while (conn->pending >= server->max_pending && !stopRequested) pthread_cond_wait(&conn->changed, &server->lock);
+        if (stopRequested) break;
+        conn->pending++;
+        pthread_mutex_unlock(&server->lock);
+        Request *request = malloc(sizeof(Request) + input_size + response_size);
+        if (request == NULL || ReadFull(conn->fd, request->pixels, input_size)) {
+            free(request);
+            pthread_mutex_lock(&server->lock);
+            conn->pending--;
+            break;
+        }
+        request->received = GetMonotonicTime();
+        request->next = NULL;
+        request->conn = conn;
+        request->response = &request->pixels[input_size];
+        pthread_mutex_lock(&server->lock);
+        if (server->tail == NULL) server->head = request; else server->tail->next = request;
+        server->tail = request;
+        server->queue_length++;
+        pthread_cond_signal(&server->queued);
+    }
+    // the writer thread carries on until any requests still queued from the connection are answered
+    conn->reading = false;
+    pthread_cond_broadcast(&conn->changed);
+    ReleaseConnection(server, conn);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+// Sends the header, then each response queued on one connection, until its reader thread has stopped and none are pending
+static void *WriterThread(void *arg) {
+    Connection *conn = arg;
+    Server *server = conn->server;
+    size_t response_size = sizeof(uint64_t) + server->net->layer_lengths[server->net->layers_count - 1] * sizeof(double);
+    uint64_t header[2] = { (uint64_t)server->net->input_size, (uint64_t)server->net->layer_lengths[server->net->layers_count - 1] };
+    if (WriteFull(conn->fd, header, sizeof(header))) {
+        conn->broken = true;
+        (void)shutdown(conn->fd, SHUT_RDWR); // wakes the reader thread
+    }
+    pthread_mutex_lock(&server->lock);
+    while (true) {
+        while (conn->head == NULL && (conn->reading || conn->pending > 0)) pthread_cond_wait(&conn->changed, &server->lock);
+        Request *request = conn->head;
+        if (request == NULL) break;
+        conn->head = request->next;
+        if (conn->head == NULL) conn->tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+        // once broken, responses are dropped, so the reader thread never waits on a client that's gone
+        bool sent = !conn->broken && WriteFull(conn->fd, request->response, response_size) == 0;
+        double latency = GetMonotonicTime() - request->received;
+        if (!sent && !conn->broken) {
+            conn->broken = true;
+            (void)shutdown(conn->fd, SHUT_RDWR);
+        }
+        free(request);
+        pthread_mutex_lock(&server->lock);
+        if (sent) RecordLatency(server->stats, latency);
+        conn->pending--;
+        pthread_cond_broadcast(&conn->changed);
+    }
+    ReleaseConnection(server, conn);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+typedef struct AcceptArgs {
+    Server *server;
+    int listenfd;
+} AcceptArgs;
+
+// Accepts connections and starts a reader and writer thread for each until `stopRequested`, reaping finished ones as it goes
+static void *AcceptThread(void *arg) {
+    AcceptArgs *args = arg;
+    Server *server = args->server;
+    struct pollfd listener = { 0 };
+    listener.fd = args->listenfd;
+    listener.events = POLLIN;
+    while (!stopRequested) {
+        ReapConnections(server);
+        // waits in `poll()` rather than `accept()`, so that it sees `stopRequested`
+        int ready = poll(&listener, 1, ACCEPT_POLL_MS);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) continue;
+        int fd = ready < 0 ? -1 : accept(args->listenfd, NULL, NULL);
+        if (fd < 0) {
+            if (ready > 0 && (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            fprintf(stderr, "Failed to accept a connection.\n");
+            break;
+        }
+        SetLowLatency(fd);
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            (void)close(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->fd = fd;
+        conn->running = 2;
+        conn->reading = true;
+        pthread_cond_init(&conn->changed, NULL);
+        if (pthread_create(&conn->writer, NULL, WriterThread, conn) != 0) {
+            pthread_cond_destroy(&conn->changed);
+            free(conn);
+            (void)close(fd);
+            continue;
+        }
+        conn->has_reader = pthread_create(&conn->reader, NULL, ReaderThread, conn) == 0;
+        pthread_mutex_lock(&server->lock);
+        if (!conn->has_reader) {
+            // the writer thread sends the header, then finds nothing pending and stops
+            conn->reading = false;
+            pthread_cond_broadcast(&conn->changed);
+            ReleaseConnection(server, conn);
+        }
+        conn->next = server->connections;
+        server->connections = conn;
+        pthread_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+// Prints the latency of the responses sent since `*windowStart` and the batches run, then starts a new window
+static void ReportWindow(Server *server, double *windowStart, size_t *batchesRun, size_t *requestsRun) {
+    double now = GetMonotonicTime();
+    pthread_mutex_lock(&server->lock);
+    if (server->stats->total > 0) {
+        PrintLatencyStats(stdout, "", server->stats, now - *windowStart);
+        if (*batchesRun > 0) printf("\tbatches: %zu, mean batch size: %.2f\n", *batchesRun, (double)*requestsRun / *batchesRun);
+        fflush(stdout);
+    }
+    ResetLatencyStats(server->stats);
+    pthread_mutex_unlock(&server->lock);
+    *batchesRun = 0;
+    *requestsRun = 0;
+    *windowStart = now;
+}
+
+// Stops every reader thread, which the accept thread must already have been joined for, so that nothing more is queued
+static void StopReading(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    for (Connection *conn = server->connections; conn != NULL; conn = conn->next) {
+        (void)shutdown(conn->fd, SHUT_RD); // ends any read in progress
+        pthread_cond_broadcast(&conn->changed); // ends any wait for `max_pending`
+    }
+    for (Connection *conn = server->connections; conn != NULL; conn = conn->next) {
+        while (conn->reading) pthread_cond_wait(&server->stopped, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Waits up to `SHUTDOWN_GRACE` seconds for every response to be sent, then shuts down any connection still sending, and
+// reaps them all
+static void CloseConnections(Server *server) {
+    struct timespec deadline = ToTimespec(GetMonotonicTime() + SHUTDOWN_GRACE);
+    bool forced = false;
+    pthread_mutex_lock(&server->lock);
+    while (true) {
+        bool running = false;
+        for (Connection *conn = server->connections; conn != NULL && !running; conn = conn->next) running = conn->running > 0;
+        if (!running) break;
+        if (forced) {
+            pthread_cond_wait(&server->stopped, &server->lock);
+        } else if (pthread_cond_timedwait(&server->stopped, &server->lock, &deadline) == ETIMEDOUT) {
+            // the writer threads of clients that aren't reading fail their sends, and drop the rest of their responses
+            for (Connection *conn = server->connections; conn != NULL; conn = conn->next) (void)shutdown(conn->fd, SHUT_RDWR);
+            forced = true;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    ReapConnections(server);
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s MODEL.nn [options]\n"
+        "\t--listen ADDRESS       unix:PATH, HOST:PORT or PORT (default \"%s\")\n"
+        "\t--max-batch N          largest micro-batch (default %d)\n"
+        "\t--max-wait-us N        longest a request waits for its batch to fill, in microseconds (default %d)\n"
+        "\t--max-pending N        unanswered requests per connection before it stops being read (default %d)\n"
+        "\t--stats-interval S     seconds between latency reports (default %.0f)\n"
+        "\t--intra-threads N      threads each layer is split across when a batch is a single request (default 1)\n",
+        program, DEFAULT_ADDRESS, DEFAULT_MAX_BATCH, DEFAULT_MAX_WAIT_US, DEFAULT_MAX_PENDING, DEFAULT_STATS_INTERVAL);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char *modelFilename = argv[1];
+    const char *address = DEFAULT_ADDRESS;
+    size_t maxBatch = DEFAULT_MAX_BATCH;
+    double maxWaitUs = DEFAULT_MAX_WAIT_US;
+    size_t maxPending = DEFAULT_MAX_PENDING;
+    double statsInterval = DEFAULT_STATS_INTERVAL;
+    size_t intraThreads = 1;
+    for (int i = 2; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--listen") == 0) {
+            address = argv[++i];
+        } else if (valid && strcmp(argv[i], "--max-batch") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &maxBatch);
+        } else if (valid && strcmp(argv[i], "--max-wait-us") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &maxWaitUs);
+        } else if (valid && strcmp(argv[i], "--max-pending") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &maxPending);
+        } else if (valid && strcmp(argv[i], "--stats-interval") == 0) {
+            valid = ParseNumberArg(argv[++i], 0.0, &statsInterval);
+        } else if (valid && strcmp(argv[i], "--intra-threads") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &intraThreads);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int returnValue = 0;
+    Network network = { 0 };
+    NetworkScratch scratch = { 0 };
+    LatencyStats stats = { 0 };
+    Request **batch = NULL;
+    char **batchPixels = NULL;
+    int listenfd = -1;
+
+    if (LoadNetwork(modelFilename, &network)) {
+        fprintf(stderr, "Failed to load network from file \"%s\".\n", modelFilename);
+        return 1;
+    }
+    Server server = { 0 };
+    server.net = &network;
+    server.max_batch = maxBatch;
+    server.max_pending = maxPending;
+    server.max_wait = maxWaitUs * 1e-6;
+    server.stats = &stats;
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&server.queued, &condattr);
+    pthread_cond_init(&server.stopped, &condattr);
+    pthread_condattr_destroy(&condattr);
+    pthread_mutex_init(&server.lock, NULL);
+    size_t output_size = network.layer_lengths[network.layers_count - 1];
+
+    batch = malloc(server.max_batch * sizeof(Request*));
+    batchPixels = malloc(server.max_batch * sizeof(char*));
+    if (batch == NULL || batchPixels == NULL || AllocScratch(&scratch, &network, server.max_batch) || InitLatencyStats(&stats, LATENCY_SAMPLES_CAPACITY)) {
+        fprintf(stderr, "Failed to allocate memory on the heap for batches.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    // with light traffic most batches are a single request, whose latency only splitting its layers can cut
+    if (intraThreads > 1 && (scratch.pool = CreateWorkPool(intraThreads)) == NULL) {
+        fprintf(stderr, "Failed to start a pool of %zu threads.\n", intraThreads);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    struct sigaction action = { 0 };
+    action.sa_handler = SIG_IGN;
+    (void)sigaction(SIGPIPE, &action, NULL); // a client disconnecting mid-response shouldn't kill the server
+    action.sa_handler = StopHandler;
+    (void)sigaction(SIGINT, &action, NULL);
+    (void)sigaction(SIGTERM, &action, NULL);
+
+    listenfd = OpenListener(address);
+    if (listenfd < 0) {
+        fprintf(stderr, "Failed to listen on \"%s\".\n", address);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    AcceptArgs acceptArgs = { &server, listenfd };
+    pthread_t acceptThread;
+    if (pthread_create(&acceptThread, NULL, AcceptThread, &acceptArgs) != 0) {
+        fprintf(stderr, "Failed to start accepting connections.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    printf("Serving \"%s\" on \"%s\" (input %zu, output %zu, max batch %zu, max wait %.0fus).\n",
+        modelFilename, address, network.input_size, output_size, server.max_batch, maxWaitUs);
+    fflush(stdout);
+
+    /* BATCHING LOOP */
+
+    size_t batchesRun = 0;
+    size_t requestsRun = 0;
+    double windowStart = GetMonotonicTime();
+    bool stopping = false;
+    while (true) {
+        if (stopRequested && !stopping) {
+            // once every reader thread has stopped nothing more is queued, so every request already read is answered
+            printf("Terminating...\n");
+            fflush(stdout);
+            (void)pthread_join(acceptThread, NULL);
+            StopReading(&server);
+            stopping = true;
+        }
+        pthread_mutex_lock(&server.lock);
+        // wait for the first request, waking up regularly to report stats and check for `stopRequested`
+        struct timespec wakeup = ToTimespec(GetMonotonicTime() + 0.1);
+        while (server.queue_length == 0 && !stopRequested) {
+            if (pthread_cond_timedwait(&server.queued, &server.lock, &wakeup) == ETIMEDOUT) break;
+        }
+        if (server.queue_length > 0) {
+            // wait for the batch to fill, but no longer than the oldest request's deadline
+            struct timespec deadline = ToTimespec(server.head->received + server.max_wait);
+            while (server.queue_length < server.max_batch && !stopRequested) {
+                if (pthread_cond_timedwait(&server.queued, &server.lock, &deadline) == ETIMEDOUT) break;
+            }
+        }
+        size_t batchSize = 0;
+        while (server.head != NULL && batchSize < server.max_batch) {
+            batch[batchSize++] = server.head;
+            server.head = server.head->next;
+        }
+        if (server.head == NULL) server.tail = NULL;
+        server.queue_length -= batchSize;
+        bool drained = stopping && server.queue_length == 0;
+        pthread_mutex_unlock(&server.lock);
+
+        if (batchSize > 0) {
+            for (size_t b = 0; b < batchSize; b++) batchPixels[b] = (char*)batch[b]->pixels;
+            LoadInputs(batchSize, network.input_size, batchPixels, scratch.inputs);
+            ForwardPassBatch(&network, batchSize, scratch.inputs, &scratch);
+            double *outputs = scratch.activated_neurons[network.layers_count - 1];
+            for (size_t b = 0; b < batchSize; b++) {
+                double *output = &outputs[b * output_size];
+                uint64_t prediction = (uint64_t)ArgMax(output_size, output);
+                memcpy(batch[b]->response, &prediction, sizeof(uint64_t));
+                memcpy(batch[b]->response + sizeof(uint64_t), output, output_size * sizeof(double));
+            }
+            // each is handed to its connection's writer thread, which frees it once sent, so a slow client never blocks a batch
+            pthread_mutex_lock(&server.lock);
+            for (size_t b = 0; b < batchSize; b++) {
+                Connection *conn = batch[b]->conn;
+                batch[b]->next = NULL;
+                if (conn->tail == NULL) conn->head = batch[b]; else conn->tail->next = batch[b];
+                conn->tail = batch[b];
+                pthread_cond_broadcast(&conn->changed);
+            }
+            pthread_mutex_unlock(&server.lock);
+            batchesRun++;
+            requestsRun += batchSize;
+        }
+
+        if (drained) break;
+        if (GetMonotonicTime() - windowStart >= statsInterval) ReportWindow(&server, &windowStart, &batchesRun, &requestsRun);
+    }
+    // the last responses are only counted once sent
+    CloseConnections(&server);
+    ReportWindow(&server, &windowStart, &batchesRun, &requestsRun);
+
+    CleanupLabel:
+
+    if (listenfd >= 0) {
+        (void)close(listenfd);
+        if (strncmp(address, "unix:", 5) == 0) (void)unlink(address + 5);
+    }
+    free(batchPixels);
+    free(batch);
+    FreeLatencyStats(&stats);
+    DestroyWorkPool(scratch.pool);
+    FreeScratch(&scratch);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.stopped);
+    pthread_cond_destroy(&server.queued);
+    FreeNetwork(&network);
+    return returnValue;
+}
\ No newline at end of file
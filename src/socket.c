@@ -0,0 +1,136 @@
+#define _POSIX_C_SOURCE 200809L // for `getaddrinfo()`
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/*
+    Contains socket functions used by the inference server and its load generator (POSIX only)
+
+    Addresses are either `unix:PATH` for a Unix domain socket, or `HOST:PORT` / `PORT` for TCP
+*/
+
+#define UNIX_PREFIX "unix:"
+
+// Fills `addr` for a Unix domain socket address; returns 0 on success, 1 on failure
+static int GetUnixAddress(const char *address, struct sockaddr_un *addr) {
+    const char *path = address + strlen(UNIX_PREFIX);
+    if (strlen(path) >= sizeof(addr->sun_path)) return 1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Resolves `HOST:PORT` or `PORT`; the caller must `freeaddrinfo()` the result if and only if this returns non-NULL
+static struct addrinfo *GetTcpAddresses(const char *address, bool passive) {
+    char host[256] = { 0 };
+    const char *port = strrchr(address, ':');
+    if (port == NULL) {
+        port = address;
+    } else {
+        if ((size_t)(port - address) >= sizeof(host)) return NULL;
+        memcpy(host, address, port - address);
+        port++;
+    }
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (passive) hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &result) != 0) return NULL;
+    return result;
+}
+
+// Returns a listening socket, or -1 on failure
+// An existing Unix domain socket file at the same path is replaced
+int OpenListener(const char *address) {
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        struct sockaddr_un addr;
+        if (GetUnixAddress(address, &addr)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        (void)unlink(addr.sun_path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) { (void)close(fd); return -1; }
+        return fd;
+    }
+    struct addrinfo *addresses = GetTcpAddresses(address, true);
+    if (addresses == NULL) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = addresses; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) break;
+        (void)close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Disables Nagle's algorithm on TCP sockets, so small responses aren't held back waiting for more data; harmless on Unix domain sockets
+void SetLowLatency(int fd) {
+    int one = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Returns a connected socket, or -1 on failure
+int ConnectTo(const char *address) {
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        struct sockaddr_un addr;
+        if (GetUnixAddress(address, &addr)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) { (void)close(fd); return -1; }
+        return fd;
+    }
+    struct addrinfo *addresses = GetTcpAddresses(address, false);
+    if (addresses == NULL) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = addresses; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        (void)close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) SetLowLatency(fd);
+    return fd;
+}
+
+// Returns 0 once exactly `len` bytes are read, 1 on failure or end of stream
+int ReadFull(int fd, void *buffer, size_t len) {
+    char *p = buffer;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Returns 0 once exactly `len` bytes are written, 1 on failure
+int WriteFull(int fd, const void *buffer, size_t len) {
+    const char *p = buffer;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "main.h"
+
+/*
+    Contains magnitude pruning and compressed sparse row (CSR) weight functions
+*/
+
+// Layers with more than this fraction of nonzero weights stay dense in `BuildSparseWeights()`, as the dense kernel is faster for them
+#define SPARSE_MAX_DENSITY 0.5
+
+// Returns 0 on success, 1 on failure
+// Masks every weight that is currently 0, so that training can't revive it
+int AllocMasks(Network *net) {
+    if (net->masks != NULL) return 0;
+    net->masks = malloc(net->layers_count * sizeof(unsigned char*));
+    net->all_masks = malloc(net->total_weight_count);
+    if (net->masks == NULL || net->all_masks == NULL) {
+        free(net->all_masks);
+        free(net->masks);
+        net->all_masks = NULL;
+        net->masks = NULL;
+        return 1;
+    }
+    for (size_t i = 0; i < net->total_weight_count; i++) net->all_masks[i] = net->all_weights[i] != 0.0;
+    for (size_t i = 0; i < net->layers_count; i++) net->masks[i] = net->all_masks + (net->weights[i] - net->all_weights);
+    return 0;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Prunes the smallest-magnitude weights of each layer until `sparsity` of the layer's weights are pruned
+// Already-pruned weights stay pruned; requires `AllocMasks()`
+void PruneNetwork(Network *net, double sparsity) {
+    size_t prevLength = net->dense_input_size;
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        size_t count = prevLength * net->layer_lengths[layer];
+        prevLength = net->layer_lengths[layer];
+        double *weights = net->weights[layer];
+        unsigned char *mask = net->masks[layer];
+        size_t target = (size_t)(sparsity * (double)count);
+        size_t pruned = 0;
+        for (size_t i = 0; i < count; i++) pruned += !mask[i];
+        if (target <= pruned) continue;
+
+        // find the magnitude of the `target`th smallest weight; pruned weights are 0 so always come first
+        double *magnitudes = malloc(count * sizeof(double));
+        if (magnitudes == NULL) continue; // pruning is best-effort; the next call will catch up
+        for (size_t i = 0; i < count; i++) magnitudes[i] = fabs(weights[i]);
+        qsort(magnitudes, count, sizeof(double), CompareDoubles);
+        double threshold = magnitudes[target - 1];
+        free(magnitudes);
+
+        // prune below the threshold, then at it until `target` is reached, so that ties don't overshoot
+        for (size_t i = 0; i < count; i++) {
+            if (mask[i] && fabs(weights[i]) < threshold) {
+                mask[i] = 0;
+                weights[i] = 0.0;
+                pruned++;
+            }
+        }
+        for (size_t i = 0; i < count && pruned < target; i++) {
+            if (mask[i] && fabs(weights[i]) == threshold) {
+                mask[i] = 0;
+                weights[i] = 0.0;
+                pruned++;
+            }
+        }
+    }
+    if (net->bf16_weights != NULL) UpdateBf16Weights(net);
+}
+
+// Sparsity to prune to after `step` of `steps` pruning steps, rising quickly at first and levelling off at `target`
+// (the cubic schedule from Zhu & Gupta, "To prune, or not to prune")
+double PruningSchedule(double target, size_t step, size_t steps) {
+    if (steps == 0 || step >= steps) return target;
+    double remaining = 1.0 - (double)step / (double)steps;
+    return target * (1.0 - remaining * remaining * remaining);
+}
+
+// Returns the fraction of weights that are exactly 0
+double GetSparsity(const Network *net) {
+    size_t zeros = 0;
+    for (size_t i = 0; i < net->total_weight_count; i++) zeros += net->all_weights[i] == 0.0;
+    return net->total_weight_count ? (double)zeros / net->total_weight_count : 0.0;
+}
+
+// Safe to call when `net->sparse_weights` is NULL
+void FreeSparseWeights(Network *net) {
+    if (net->sparse_weights == NULL) return;
+    for (size_t i = 0; i < net->layers_count; i++) {
+        free(net->sparse_weights[i].values);
+        free(net->sparse_weights[i].col_indices);
+        free(net->sparse_weights[i].row_starts);
+    }
+    free(net->sparse_weights);
+    net->sparse_weights = NULL;
+}
+
+// Returns 0 on success, 1 on failure
+// Builds `net->sparse_weights` from the current weights, used by `ForwardPassBatch()` for every layer sparse enough to benefit
+// Must be rebuilt (or freed) whenever the weights change
+int BuildSparseWeights(Network *net) {
+    FreeSparseWeights(net);
+    net->sparse_weights = calloc(net->layers_count, sizeof(CsrMatrix));
+    if (net->sparse_weights == NULL) return 1;
+    size_t prevLength = net->dense_input_size;
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        CsrMatrix *matrix = &net->sparse_weights[layer];
+        double *weights = net->weights[layer];
+        matrix->rows = net->layer_lengths[layer];
+        matrix->cols = prevLength;
+        prevLength = matrix->rows;
+        for (size_t i = 0; i < matrix->rows * matrix->cols; i++) matrix->nnz += weights[i] != 0.0;
+        if (matrix->nnz > SPARSE_MAX_DENSITY * (double)(matrix->rows * matrix->cols) || matrix->cols > UINT32_MAX) continue;
+        matrix->row_starts = malloc((matrix->rows + 1) * sizeof(size_t));
+        matrix->col_indices = malloc((matrix->nnz + 1) * sizeof(uint32_t));
+        matrix->values = malloc((matrix->nnz + 1) * sizeof(double));
+        if (matrix->row_starts == NULL || matrix->col_indices == NULL || matrix->values == NULL) {
+            FreeSparseWeights(net);
+            return 1;
+        }
+        size_t j = 0;
+        for (size_t row = 0; row < matrix->rows; row++) {
+            matrix->row_starts[row] = j;
+            for (size_t col = 0; col < matrix->cols; col++) {
+                double weight = weights[(row * matrix->cols) + col];
+                if (weight == 0.0) continue;
+                matrix->col_indices[j] = (uint32_t)col;
+                matrix->values[j] = weight;
+                j++;
+            }
+        }
+        matrix->row_starts[matrix->rows] = j;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L // for `clock_gettime()`
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+/*
+    Contains timing and latency statistics functions used by the serving and benchmarking tools
+*/
+
+// Returns seconds since an arbitrary fixed point; unlike `clock()`, counts wall time rather than CPU time
+double GetMonotonicTime(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+// Returns 0 on success, 1 on failure
+int InitLatencyStats(LatencyStats *stats, size_t capacity) {
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = malloc(capacity * sizeof(double));
+    if (stats->samples == NULL) return 1;
+    stats->capacity = capacity;
+    return 0;
+}
+
+void FreeLatencyStats(LatencyStats *stats) {
+    free(stats->samples);
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Forgets all recorded samples, keeping the allocation
+void ResetLatencyStats(LatencyStats *stats) {
+    stats->count = 0;
+    stats->total = 0;
+}
+
+// Records one latency in seconds
+// Once `capacity` samples are held, later samples are only counted (for throughput) and not used for percentiles
+void RecordLatency(LatencyStats *stats, double seconds) {
+    if (stats->count < stats->capacity) stats->samples[stats->count++] = seconds;
+    stats->total++;
+}
+
+// Appends the samples of `src` to `dst`
+void MergeLatencyStats(LatencyStats *dst, const LatencyStats *src) {
+    for (size_t i = 0; i < src->count; i++) RecordLatency(dst, src->samples[i]);
+    dst->total += src->total - src->count;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Returns the `p`th percentile (`0.0 <= p <= 1.0`) of the recorded samples, or 0 if there are none
+// Sorts the samples in place
+double LatencyPercentile(LatencyStats *stats, double p) {
+    if (stats->count == 0) return 0.0;
+    qsort(stats->samples, stats->count, sizeof(double), CompareDoubles);
+    size_t index = (size_t)(p * (double)(stats->count - 1) + 0.5);
+    return stats->samples[index];
+}
+
+// Prints request count, throughput and latency percentiles (in ms) on one line
+// `elapsed` is the wall time in seconds that the samples were recorded over
+void PrintLatencyStats(FILE *f, const char *label, LatencyStats *stats, double elapsed) {
+    double mean = 0.0;
+    for (size_t i = 0; i < stats->count; i++) mean += stats->samples[i];
+    if (stats->count) mean /= stats->count;
+    double p50 = LatencyPercentile(stats, 0.50);
+    double p90 = LatencyPercentile(stats, 0.90);
+    double p99 = LatencyPercentile(stats, 0.99);
+    double max = stats->count ? stats->samples[stats->count - 1] : 0.0;
+    fprintf(f, "%s%zu requests, %.1f QPS, latency ms: mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+        label, stats->total, elapsed > 0.0 ? (double)stats->total / elapsed : 0.0, mean * 1e3, p50 * 1e3, p90 * 1e3, p99 * 1e3, max * 1e3);
+}
\ No newline at end of file
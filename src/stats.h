@@ -0,0 +1,16 @@
+#ifndef _STATS_H
+    #define _STATS_H
+
+
+    #include <stddef.h>
+
+    // Latency samples in seconds, for percentiles and throughput
+    typedef struct LatencyStats {
+        double *samples;
+        size_t count; // samples held in `samples`
+        size_t capacity;
+        size_t total; // samples recorded, including ones dropped once `samples` was full
+    } LatencyStats;
+
+
+#endif
\ No newline at end of file
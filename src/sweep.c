@@ -0,0 +1,372 @@
+#include "main.h"
+
+/*
+    Hyperparameter sweep: trains every combination of the given layers, learning rates, multipliers and batch sizes concurrently,
+    sharing one copy of the datasets, and ranks them
+
+    The datasets are loaded once and only ever read; every run owns its own network and scratch, and runs are spread over a
+    thread pool one per task. Runs are culled by successive halving: after each rung, only the best `1 / --eta` (by accuracy on
+    a validation split held out from the end of the training set) go on to train for `--eta` times as many epochs
+    Datasets, the learning rate, the multiplier and the layers default to the config file's, like `cnn`
+*/
+
+#define DEFAULT_MIN_EPOCHS 1
+#define DEFAULT_MAX_EPOCHS 8
+#define DEFAULT_ETA 2
+#define DEFAULT_VALIDATION_FRACTION 10 // percent of the training set held out when `--validation` isn't given
+#define MAX_VALUES 16 // per list
+#define MAX_LAYERS 64
+#define MAX_RUNS 256
+
+typedef struct SweepRun {
+    const size_t *layer_lengths;
+    size_t layers_count;
+    double learning_rate;
+    double multiplier;
+    size_t batch_size;
+    Network net; // each run has its own weight arena
+    TrainingScratch training; // freed once the run is culled
+    NetworkScratch testing;
+    size_t epochs; // trained so far
+    double seconds; // spent training so far
+    double validation_accuracy;
+    double test_accuracy;
+    bool culled;
+} SweepRun;
+
+typedef struct SweepContext {
+    SweepRun **live; // runs still training
+    size_t target_epochs; // for this rung
+    // shared by every run, and never written
+    char **images;
+    char *labels;
+    size_t training_count;
+    size_t validation_count; // held out after `training_count`
+    char **test_images;
+    char *test_labels;
+    size_t testing_count;
+} SweepContext;
+
+// Trains live runs `[begin, end)` up to the rung's epochs and evaluates them
+static void TrainRunsTask(void *context, size_t worker, size_t begin, size_t end) {
+    SweepContext *ctx = context;
+    (void)worker; // every run has its own scratch
+    for (size_t i = begin; i < end; i++) {
+        SweepRun *run = ctx->live[i];
+        for (; run->epochs < ctx->target_epochs; run->epochs++) {
+            double learningRate = run->learning_rate * pow(run->multiplier, (double)run->epochs);
+            double start = GetMonotonicTime();
+            TrainEpoch(&run->net, &run->training, ctx->training_count, ctx->images, ctx->labels, learningRate);
+            run->seconds += GetMonotonicTime() - start;
+        }
+        size_t validationRight = Evaluate(&run->net, &run->testing, ctx->validation_count, &ctx->images[ctx->training_count], &ctx->labels[ctx->training_count], NULL);
+        size_t testRight = Evaluate(&run->net, &run->testing, ctx->testing_count, ctx->test_images, ctx->test_labels, NULL);
+        run->validation_accuracy = (double)validationRight / ctx->validation_count;
+        run->test_accuracy = (double)testRight / ctx->testing_count;
+    }
+}
+
+// Orders runs best first: furthest trained, then most accurate on the validation split, then fastest
+static int CompareRuns(const void *a, const void *b) {
+    const SweepRun *runA = *(SweepRun *const *)a;
+    const SweepRun *runB = *(SweepRun *const *)b;
+    if (runA->epochs != runB->epochs) return runA->epochs < runB->epochs ? 1 : -1;
+    if (runA->validation_accuracy != runB->validation_accuracy) return runA->validation_accuracy < runB->validation_accuracy ? 1 : -1;
+    if (runA->seconds != runB->seconds) return runA->seconds > runB->seconds ? 1 : -1;
+    return 0;
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\t--layers LISTS         `/`-separated dense layer lists, including the output layer, e.g. 64,10/128,10 (default: the config file's)\n"
+        "\t--learning-rates LIST  comma-separated learning rates (default: the config file's)\n"
+        "\t--multipliers LIST     comma-separated learning rate multipliers between epochs (default: the config file's, or 1)\n"
+        "\t--batch-sizes LIST     comma-separated training batch sizes (default 1)\n"
+        "\t--min-epochs N         epochs every run trains before the first cull (default %d)\n"
+        "\t--max-epochs N         epochs the surviving runs train for (default %d)\n"
+        "\t--eta N                keep the best 1/N of runs after each rung, and train them N times as long; 1 disables culling (default %d)\n"
+        "\t--validation N         training images held out to rank runs by (default %d%% of them)\n"
+        "\t--threads N            runs trained at once (default: one per core)\n"
+        "\t--seed N               seed for the initial weights; runs with the same layers start identical (default: the time)\n"
+        "\t--save FILE            save the best run's network\n",
+        program, DEFAULT_MIN_EPOCHS, DEFAULT_MAX_EPOCHS, DEFAULT_ETA, DEFAULT_VALIDATION_FRACTION);
+}
+
+int main(int argc, char **argv) {
+    size_t argLayerLengths[MAX_VALUES][MAX_LAYERS];
+    size_t argLayersCounts[MAX_VALUES];
+    size_t layerListCount = 0;
+    double learningRates[MAX_VALUES];
+    size_t learningRateCount = 0;
+    double multipliers[MAX_VALUES];
+    size_t multiplierCount = 0;
+    size_t batchSizes[MAX_VALUES] = { 1 };
+    size_t batchSizeCount = 1;
+    size_t minEpochs = DEFAULT_MIN_EPOCHS;
+    size_t maxEpochs = DEFAULT_MAX_EPOCHS;
+    size_t eta = DEFAULT_ETA;
+    size_t validationCount = 0;
+    bool validationCount_set = false;
+    size_t threadCount = 0;
+    size_t seed = (size_t)time(NULL);
+    const char *saveFilename = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--layers") == 0) {
+            valid = ParseSizeLists(argv[++i], 1, &argLayerLengths[0][0], MAX_LAYERS, argLayersCounts, MAX_VALUES, &layerListCount);
+        } else if (valid && strcmp(argv[i], "--learning-rates") == 0) {
+            valid = ParseNumberList(argv[++i], 0.0, learningRates, MAX_VALUES, &learningRateCount);
+        } else if (valid && strcmp(argv[i], "--multipliers") == 0) {
+            valid = ParseNumberList(argv[++i], 0.0, multipliers, MAX_VALUES, &multiplierCount);
+        } else if (valid && strcmp(argv[i], "--batch-sizes") == 0) {
+            valid = ParseSizeList(argv[++i], 1, batchSizes, MAX_VALUES, &batchSizeCount);
+        } else if (valid && strcmp(argv[i], "--min-epochs") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &minEpochs);
+        } else if (valid && strcmp(argv[i], "--max-epochs") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &maxEpochs);
+        } else if (valid && strcmp(argv[i], "--eta") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &eta);
+        } else if (valid && strcmp(argv[i], "--validation") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &validationCount);
+            validationCount_set = true;
+        } else if (valid && strcmp(argv[i], "--threads") == 0) {
+            valid = ParseSizeArg(argv[++i], 1, &threadCount);
+        } else if (valid && strcmp(argv[i], "--seed") == 0) {
+            valid = ParseSizeArg(argv[++i], 0, &seed);
+        } else if (valid && strcmp(argv[i], "--save") == 0) {
+            saveFilename = argv[++i];
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (minEpochs > maxEpochs) minEpochs = maxEpochs;
+
+    int returnValue = 0;
+    char training_images_filename[MAX_PATH] = { 0 };
+    char training_labels_filename[MAX_PATH] = { 0 };
+    char testing_images_filename[MAX_PATH] = { 0 };
+    char testing_labels_filename[MAX_PATH] = { 0 };
+    char **images = NULL;
+    char *labels = NULL;
+    char **test_images = NULL;
+    char *test_labels = NULL;
+    size_t *layer_lengths = NULL;
+    ConvLayer *conv_layers = NULL;
+    SweepRun *runs = NULL;
+    SweepRun **ranked = NULL;
+    size_t runCount = 0;
+    ThreadPool *pool = NULL;
+
+    bool layers_count_set = false;
+    size_t layers_count = 0;
+    size_t conv_count = 0;
+    double learningRate = 0.0;
+    bool learningRateMultiplier_set = false;
+    double learningRateMultiplier = 0.0;
+    GetConfigContext configContext = { 0 };
+    configContext.learningRateMultiplier_set = &learningRateMultiplier_set;
+    configContext.learningRateMultiplier = &learningRateMultiplier;
+    configContext.layersCount_set = &layers_count_set;
+    configContext.layersCount = &layers_count;
+    configContext.layerLengths = &layer_lengths;
+    configContext.convLayersCount = &conv_count;
+    configContext.convLayers = &conv_layers;
+    if (GetDatasetConfig(CONFIG_FILENAME, training_images_filename, training_labels_filename, testing_images_filename, testing_labels_filename, &learningRate, &configContext)) {
+        fprintf(stderr, "Failed to read config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    if (learningRateCount == 0 && learningRate > 0.0) learningRates[learningRateCount++] = learningRate;
+    if (multiplierCount == 0) multipliers[multiplierCount++] = learningRateMultiplier_set ? learningRateMultiplier : 1.0;
+    if (layerListCount == 0 && layers_count > 0) {
+        if (layers_count > MAX_LAYERS) {
+            fprintf(stderr, "Config file \"%s\" has %zu layers; at most %d can be swept.\n", CONFIG_FILENAME, layers_count, MAX_LAYERS);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        memcpy(argLayerLengths[0], layer_lengths, layers_count * sizeof(size_t));
+        argLayersCounts[layerListCount++] = layers_count;
+    }
+    if (learningRateCount == 0 || layerListCount == 0) {
+        fprintf(stderr, "No learning rates or layers given with --learning-rates and --layers or in config file \"%s\".\n", CONFIG_FILENAME);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    runCount = layerListCount * learningRateCount * multiplierCount * batchSizeCount;
+    if (runCount > MAX_RUNS) {
+        fprintf(stderr, "Too many combinations (%zu); at most %d can be swept at once.\n", runCount, MAX_RUNS);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    /* LOAD THE SHARED DATASETS */
+
+    uint32_t image_count, label_count, test_image_count, test_label_count, row_count, col_count, test_row_count, test_col_count;
+    images = GetImages(training_images_filename, &image_count, &row_count, &col_count);
+    labels = GetLabels(training_labels_filename, &label_count);
+    if (images == NULL || labels == NULL) {
+        fprintf(stderr, "Failed to retrieve training data from files \"%s\" and \"%s\".\n", training_images_filename, training_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    test_images = GetImages(testing_images_filename, &test_image_count, &test_row_count, &test_col_count);
+    test_labels = GetLabels(testing_labels_filename, &test_label_count);
+    if (test_images == NULL || test_labels == NULL || test_row_count != row_count || test_col_count != col_count) {
+        fprintf(stderr, "Failed to retrieve testing data matching the training data from files \"%s\" and \"%s\".\n", testing_images_filename, testing_labels_filename);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t imageCount = image_count < label_count ? image_count : label_count;
+    if (!validationCount_set) validationCount = imageCount * DEFAULT_VALIDATION_FRACTION / 100;
+    if (validationCount == 0 || validationCount >= imageCount) {
+        fprintf(stderr, "The validation split must leave some of the %zu training images to train on.\n", imageCount);
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    SweepContext ctx = { 0 };
+    ctx.images = images;
+    ctx.labels = labels;
+    ctx.training_count = imageCount - validationCount;
+    ctx.validation_count = validationCount;
+    ctx.test_images = test_images;
+    ctx.test_labels = test_labels;
+    ctx.testing_count = test_image_count < test_label_count ? test_image_count : test_label_count;
+
+    /* ALLOCATE EVERY RUN */
+
+    runs = calloc(runCount, sizeof(SweepRun));
+    ranked = malloc(runCount * sizeof(SweepRun*));
+    if (runs == NULL || ranked == NULL) {
+        fprintf(stderr, "Failed to allocate memory on the heap for runs.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    size_t runBytes = 0;
+    for (size_t i = 0; i < runCount; i++) {
+        SweepRun *run = &runs[i];
+        // the layers vary slowest, so runs sharing layers are adjacent
+        size_t index = i;
+        run->batch_size = batchSizes[index % batchSizeCount];
+        index /= batchSizeCount;
+        run->multiplier = multipliers[index % multiplierCount];
+        index /= multiplierCount;
+        run->learning_rate = learningRates[index % learningRateCount];
+        index /= learningRateCount;
+        run->layer_lengths = argLayerLengths[index];
+        run->layers_count = argLayersCounts[index];
+        if (AllocConvNetwork(&run->net, row_count, col_count, conv_count, conv_layers, run->layers_count, run->layer_lengths)) {
+            fprintf(stderr, "Failed to allocate a network for the layers given, which must fit %u x %u images.\n", col_count, row_count);
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        if (AllocTrainingScratch(&run->training, &run->net, run->batch_size, 0) || AllocScratch(&run->testing, &run->net, TESTING_BATCH_SIZE)) {
+            fprintf(stderr, "Failed to allocate memory on the heap for neurons.\n");
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        // `rand()` isn't thread-safe, so every run is initialised here rather than on the pool
+        srand((unsigned int)seed);
+        InitialiseNetwork(&run->net);
+        runBytes += (run->net.total_conv_param_count + run->net.total_weight_count + run->net.total_neuron_count) * sizeof(double) + run->training.bytes + run->testing.bytes;
+        ranked[i] = run;
+    }
+
+    pool = CreateThreadPool(threadCount);
+    if (pool == NULL) {
+        fprintf(stderr, "Failed to start the thread pool.\n");
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+
+    size_t datasetBytes = (size_t)(imageCount + ctx.testing_count) * ((size_t)row_count * col_count + 1);
+    printf("Sweeping %zu runs on %zu threads: %zu training images, %zu held out for validation, %zu test images\n",
+        runCount, ThreadPoolSize(pool), ctx.training_count, ctx.validation_count, ctx.testing_count);
+    printf("Datasets: %.2f MiB, loaded once and shared by every run; networks and buffers: %.2f MiB across all runs\n\n",
+        (double)datasetBytes / (1024.0 * 1024.0), (double)runBytes / (1024.0 * 1024.0));
+    if (conv_count > 0) printf("Every run starts with the config file's %zu convolution/pooling layers\n", conv_count);
+    fflush(stdout);
+
+    /* SUCCESSIVE HALVING */
+
+    double start = GetMonotonicTime();
+    size_t liveCount = runCount;
+    size_t budget = eta == 1 ? maxEpochs : minEpochs;
+    ctx.live = ranked; // live runs are kept at the front of `ranked`
+    for (size_t rung = 1;; rung++) {
+        ctx.target_epochs = budget < maxEpochs ? budget : maxEpochs;
+        double rungStart = GetMonotonicTime();
+        ParallelFor(pool, liveCount, 1, TrainRunsTask, &ctx);
+        qsort(ranked, liveCount, sizeof(SweepRun*), CompareRuns);
+        printf("Rung %zu: %zu runs trained to %zu epochs in %.2fs; best validation accuracy %.4f\n", rung, liveCount, ctx.target_epochs,
+            GetMonotonicTime() - rungStart, ranked[0]->validation_accuracy);
+        fflush(stdout);
+        if (ctx.target_epochs == maxEpochs) break;
+        size_t keep = (liveCount + eta - 1) / eta;
+        for (size_t i = keep; i < liveCount; i++) {
+            ranked[i]->culled = true;
+            FreeTrainingScratch(&ranked[i]->training);
+        }
+        liveCount = keep;
+        budget *= eta;
+    }
+    double elapsed = GetMonotonicTime() - start;
+
+    /* REPORT */
+
+    qsort(ranked, runCount, sizeof(SweepRun*), CompareRuns);
+    size_t epochsTrained = 0;
+    double trainingSeconds = 0.0;
+    for (size_t i = 0; i < runCount; i++) {
+        epochsTrained += runs[i].epochs;
+        trainingSeconds += runs[i].seconds;
+    }
+    printf("\n| Rank | Layers               | Learning rate | Multiplier | Batch | Epochs | Time (s) | Validation | Test   |\n");
+    printf("| ---- | -------------------- | ------------- | ---------- | ----- | ------ | -------- | ---------- | ------ |\n");
+    for (size_t i = 0; i < runCount; i++) {
+        const SweepRun *run = ranked[i];
+        char layers[64];
+        size_t length = 0;
+        for (size_t j = 0; j < run->layers_count && length < sizeof(layers); j++) {
+            length += (size_t)snprintf(&layers[length], sizeof(layers) - length, j == 0 ? "%zu" : ",%zu", run->layer_lengths[j]);
+        }
+        printf("| %4zu | %-20s | %13g | %10g | %5zu | %6zu | %8.2f | %10.4f | %.4f |\n", i + 1, layers, run->learning_rate,
+            run->multiplier, run->batch_size, run->epochs, run->seconds, run->validation_accuracy, run->test_accuracy);
+    }
+    printf("\nTrained %zu epochs (%zu without culling) in %.2fs wall time; per-run training times sum to %.2fs\n",
+        epochsTrained, runCount * maxEpochs, elapsed, trainingSeconds);
+
+    if (saveFilename != NULL) {
+        if (SaveNetwork(saveFilename, &ranked[0]->net)) {
+            fprintf(stderr, "Failed to write to the file \"%s\".\n", saveFilename);
+            returnValue = 1;
+        } else {
+            printf("Saved the best run to \"%s\".\n", saveFilename);
+        }
+    }
+
+    CleanupLabel:
+
+    DestroyThreadPool(pool);
+    for (size_t i = 0; runs != NULL && i < runCount; i++) {
+        FreeScratch(&runs[i].testing);
+        FreeTrainingScratch(&runs[i].training);
+        FreeNetwork(&runs[i].net);
+    }
+    free(ranked);
+    free(runs);
+    free(test_labels);
+    if (test_images != NULL) free(test_images[0]);
+    free(test_images);
+    free(labels);
+    if (images != NULL) free(images[0]);
+    free(images);
+    free(conv_layers);
+    free(layer_lengths);
+    return returnValue;
+}
\ No newline at end of file
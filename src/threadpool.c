@@ -0,0 +1,171 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L // for `sysconf()`
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "threadpool.h"
+#ifdef NN_USE_THREADS
+    #include <pthread.h>
+#endif
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+/*
+    Contains a fixed-size thread pool for splitting loops across cores
+
+    Built without `NN_USE_THREADS` (e.g. no pthreads available), every pool has a single thread and runs loops serially
+*/
+
+struct ThreadPool {
+    size_t thread_count; // including the thread calling `ParallelFor()`
+#ifdef NN_USE_THREADS
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start; // signalled when a loop is posted or the pool is stopping
+    pthread_cond_t done; // signalled when the last worker finishes a loop
+    size_t generation; // incremented for every loop posted
+    size_t pending; // workers still running the current loop
+    bool stopping;
+    // current loop
+    ParallelTask task;
+    void *context;
+    size_t count;
+    size_t grain;
+    size_t next; // first index not yet claimed
+#endif
+};
+
+// Returns the number of online cores, or 1 if unknown
+size_t GetCoreCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+#endif
+}
+
+#ifdef NN_USE_THREADS
+typedef struct WorkerArgs {
+    ThreadPool *pool;
+    size_t worker;
+} WorkerArgs;
+
+// Claims and runs chunks of `grain` indices until none are left
+static void RunChunks(ThreadPool *pool, size_t worker) {
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        size_t begin = pool->next;
+        size_t end = begin + pool->grain < pool->count ? begin + pool->grain : pool->count;
+        pool->next = end;
+        pthread_mutex_unlock(&pool->lock);
+        if (begin >= end) return;
+        pool->task(pool->context, worker, begin, end);
+    }
+}
+
+static void *WorkerThread(void *arg) {
+    WorkerArgs args = *(WorkerArgs*)arg;
+    free(arg);
+    ThreadPool *pool = args.pool;
+    size_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->stopping) pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stopping) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        RunChunks(pool, args.worker);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+#endif
+
+// Returns NULL on failure
+// `thread_count == 0` uses one thread per core; the calling thread counts as one of the threads
+ThreadPool *CreateThreadPool(size_t thread_count) {
+    if (thread_count == 0) thread_count = GetCoreCount();
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (pool == NULL) return NULL;
+    pool->thread_count = 1;
+#ifdef NN_USE_THREADS
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) { free(pool); return NULL; }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (; pool->thread_count < thread_count; pool->thread_count++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (args == NULL) break;
+        args->pool = pool;
+        args->worker = pool->thread_count;
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, WorkerThread, args) != 0) {
+            free(args);
+            break;
+        }
+    }
+#else
+    (void)thread_count;
+#endif
+    return pool;
+}
+
+// Safe to call with NULL
+void DestroyThreadPool(ThreadPool *pool) {
+    if (pool == NULL) return;
+#ifdef NN_USE_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 1; i < pool->thread_count; i++) (void)pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+#endif
+    free(pool);
+}
+
+// Number of threads, including the calling thread; fewer than requested if some couldn't be started
+size_t ThreadPoolSize(const ThreadPool *pool) {
+    return pool->thread_count;
+}
+
+// Runs `task` over `[0, count)` in chunks of at most `grain` indices spread across the pool, returning once all are done
+// Not reentrant: `task` must not call `ParallelFor()` on the same pool
+void ParallelFor(ThreadPool *pool, size_t count, size_t grain, ParallelTask task, void *context) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+#ifdef NN_USE_THREADS
+    if (pool->thread_count > 1 && count > grain) {
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->context = context;
+        pool->count = count;
+        pool->grain = grain;
+        pool->next = 0;
+        pool->pending = pool->thread_count - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        RunChunks(pool, 0);
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+#else
+    (void)pool;
+#endif
+    for (size_t begin = 0; begin < count; begin += grain) task(context, 0, begin, begin + grain < count ? begin + grain : count);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef _THREADPOOL_H
+    #define _THREADPOOL_H
+
+
+    #include <stddef.h>
+
+    // Opaque; see `threadpool.c`
+    typedef struct ThreadPool ThreadPool;
+
+    // Opaque; see `workpool.c`
+    typedef struct WorkPool WorkPool;
+
+    // Called with a range `[begin, end)` of loop indices; `worker` is in `[0, thread count)` and unique among concurrently running calls
+    typedef void (*ParallelTask)(void *context, size_t worker, size_t begin, size_t end);
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "main.h"
+#ifdef __APPLE__
+    #include <sys/sysctl.h>
+#endif
+
+/*
+    Contains the auto-tuner, which times short trials of the training and testing kernels for a network's layer shapes on this
+    host and picks the fastest settings (see `Tuning`), and the tuning cache they're kept in
+
+    Each line of the cache is tab-separated: CPU model, core count, layer shapes and training batch size (the key), then the
+    forward, backward and update tiles, testing batch size and thread count; the last line with a matching key is used, so a
+    cache can be shared by hosts of different types
+*/
+
+#define TRIAL_SECONDS 0.02 // per round of a candidate
+#define TRIAL_ROUNDS 5 // the fastest round of each candidate is kept
+#define MIN_TRIAL_ROUNDS 2 // rounds run even once a pick has taken `PICK_SECONDS`, as big layers can take longer than that for a round
+#define PICK_SECONDS 0.5 // after which no more rounds are started for a pick
+#define TUNING_MARGIN 1.05 // how much faster than the default a candidate must be to be picked over it, so noise doesn't pick candidates
+#define MAX_CANDIDATES 16
+#define TUNING_KEY_LENGTH 1024
+
+// The first of each is the default
+static const size_t tileCandidates[] = { 0, 64, 128, 256, 512, 1024 };
+static const size_t testingBatchCandidates[] = { TESTING_BATCH_SIZE, 1, 4, 16, 256 };
+
+typedef enum TrialKernel {
+    FORWARD_KERNEL, // `TransformBatch()`
+    BACKWARD_KERNEL, // `TransformBatchTransposed()`
+    UPDATE_KERNEL // `DescendBatch()`
+} TrialKernel;
+
+// Runs one kernel over every dense layer's shape, on buffers big enough for the largest layer
+typedef struct KernelTrial {
+    const Network *net;
+    TrialKernel kernel;
+    size_t batch;
+    size_t tile;
+    const size_t *candidates; // tiles or batch sizes
+    double *weights;
+    double *biases;
+    double *inputs;
+    double *outputs;
+} KernelTrial;
+
+// Runs single-sample training steps that leave the network as it is
+typedef struct StepTrial {
+    Network *net;
+    TrainingScratch *scratch;
+    char *image;
+    char label;
+    size_t candidates[MAX_CANDIDATES]; // thread counts
+} StepTrial;
+
+static void RunKernelTrial(void *context) {
+    KernelTrial *trial = context;
+    const Network *net = trial->net;
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        size_t width = layer == 0 ? net->dense_input_size : net->layer_lengths[layer - 1];
+        size_t height = net->layer_lengths[layer];
+        switch (trial->kernel) {
+            case FORWARD_KERNEL:
+                TransformBatch(width, height, trial->batch, trial->weights, trial->inputs, trial->outputs, trial->tile);
+                break;
+            case BACKWARD_KERNEL:
+                // the first layer's input jacobian is never needed
+                if (layer > 0) TransformBatchTransposed(width, height, trial->batch, trial->weights, trial->outputs, trial->inputs, trial->tile);
+                break;
+            case UPDATE_KERNEL:
+                // a step too small to move the buffers far, but not 0, which `DescendBatch()` skips
+                DescendBatch(width, height, trial->batch, trial->inputs, trial->weights, trial->biases, trial->outputs, 1e-12, NULL, trial->tile);
+                break;
+        }
+    }
+}
+
+static void RunStepTrial(void *context) {
+    StepTrial *trial = context;
+    // a learning rate of 0 does all the work of a step but leaves the network as it is
+    TrainEpoch(trial->net, trial->scratch, 1, &trial->image, &trial->label, 0.0);
+}
+
+// The `Select*()` functions set up candidate `candidate` of a trial, returning the samples each call of it runs
+
+static double SelectTile(void *context, size_t candidate) {
+    KernelTrial *trial = context;
+    trial->tile = trial->candidates[candidate];
+    return 1.0;
+}
+
+static double SelectTestingBatch(void *context, size_t candidate) {
+    KernelTrial *trial = context;
+    trial->batch = trial->candidates[candidate];
+    return (double)trial->batch;
+}
+
+static double SelectThreads(void *context, size_t candidate) {
+    StepTrial *trial = context;
+    DestroyWorkPool(trial->scratch->forward.pool);
+    // if the pool can't be started, the candidate is timed running serially, so is never picked
+    size_t threads = trial->candidates[candidate];
+    trial->scratch->forward.pool = threads > 1 ? CreateWorkPool(threads) : NULL;
+    return 1.0;
+}
+
+// Returns the index of the candidate with the least time per sample, or 0 (the default) unless another beats it by `TUNING_MARGIN`
+// Rounds of each candidate are interleaved, so changes in the host's speed (other processes, frequency scaling) affect all alike
+static size_t PickFastest(size_t count, double (*select)(void *context, size_t candidate), void (*trial)(void *context), void *context) {
+    double best[MAX_CANDIDATES];
+    for (size_t c = 0; c < count; c++) best[c] = HUGE_VAL;
+    double pickStart = GetMonotonicTime();
+    for (size_t round = 0; round < TRIAL_ROUNDS && (round < MIN_TRIAL_ROUNDS || GetMonotonicTime() - pickStart < PICK_SECONDS); round++) {
+        for (size_t c = 0; c < count; c++) {
+            double samples = select(context, c);
+            if (round == 0) trial(context); // warm the caches
+            size_t calls = 0;
+            double start = GetMonotonicTime();
+            double elapsed;
+            do {
+                trial(context);
+                calls++;
+            } while ((elapsed = GetMonotonicTime() - start) < TRIAL_SECONDS);
+            double time = elapsed / (double)calls / samples;
+            if (time < best[c]) best[c] = time;
+        }
+    }
+    size_t fastest = 0;
+    for (size_t c = 1; c < count; c++) {
+        if (best[c] * TUNING_MARGIN < best[0] && best[c] < best[fastest]) fastest = c;
+    }
+    return fastest;
+}
+
+// Returns the number of `tileCandidates` worth trying on a dimension of `limit`, as tiles at least that big are the same as 0
+static size_t CountTileCandidates(size_t limit) {
+    size_t count = 1;
+    while (count < sizeof(tileCandidates) / sizeof(tileCandidates[0]) && tileCandidates[count] < limit) count++;
+    return count;
+}
+
+// Sets `tuning` to the settings used without tuning
+void DefaultTuning(Tuning *tuning) {
+    memset(&tuning->tiles, 0, sizeof(tuning->tiles));
+    tuning->testing_batch = TESTING_BATCH_SIZE;
+    tuning->threads = 1;
+}
+
+// Returns 0 on success, 1 on failure
+// Times trials of `net`'s layer shapes on this host, and sets `tuning` to the fastest settings for training in batches of `training_batch` and testing
+// `net` is left as it is
+//
+// NOTE: the backward and update kernels are only used by batches, so their tiles are only tuned with a `training_batch` above 1,
+//       and threads are only used by single samples, so they're only tuned with a `training_batch` of 1
+int TuneNetwork(Network *net, size_t training_batch, Tuning *tuning) {
+    DefaultTuning(tuning);
+    size_t widest = net->dense_input_size;
+    size_t tallest = 0;
+    size_t longest = net->dense_input_size; // of any layer, for the buffers
+    size_t largest = 0;
+    for (size_t layer = 0; layer < net->layers_count; layer++) {
+        size_t width = layer == 0 ? net->dense_input_size : net->layer_lengths[layer - 1];
+        if (width > widest) widest = width;
+        if (layer > 0 && net->layer_lengths[layer] > tallest) tallest = net->layer_lengths[layer];
+        if (net->layer_lengths[layer] > longest) longest = net->layer_lengths[layer];
+        if (width * net->layer_lengths[layer] > largest) largest = width * net->layer_lengths[layer];
+    }
+    size_t testingBatchCount = sizeof(testingBatchCandidates) / sizeof(testingBatchCandidates[0]);
+    size_t maxBatch = training_batch;
+    for (size_t i = 0; i < testingBatchCount; i++) {
+        if (testingBatchCandidates[i] > maxBatch) maxBatch = testingBatchCandidates[i];
+    }
+
+    int returnValue = 0;
+    KernelTrial trial = { 0 };
+    trial.net = net;
+    trial.weights = malloc(largest * sizeof(double));
+    trial.biases = malloc(longest * sizeof(double));
+    trial.inputs = malloc(maxBatch * longest * sizeof(double));
+    trial.outputs = malloc(maxBatch * longest * sizeof(double));
+    TrainingScratch stepScratch = { 0 };
+    char *image = calloc(net->input_size, 1);
+    if (trial.weights == NULL || trial.biases == NULL || trial.inputs == NULL || trial.outputs == NULL || image == NULL) {
+        returnValue = 1;
+        goto CleanupLabel;
+    }
+    // any small values will do, but not random ones, so tuning doesn't disturb `rand()`
+    for (size_t i = 0; i < largest; i++) trial.weights[i] = (double)(i % 17) / 17.0 - 0.5;
+    for (size_t i = 0; i < longest; i++) trial.biases[i] = 0.0;
+    for (size_t i = 0; i < maxBatch * longest; i++) {
+        trial.inputs[i] = (double)(i % 13) / 13.0;
+        trial.outputs[i] = (double)(i % 11) / 11.0 - 0.5;
+    }
+
+    // forward tile for the batches it's used with most
+    trial.candidates = tileCandidates;
+    trial.kernel = FORWARD_KERNEL;
+    trial.batch = training_batch > 1 ? training_batch : TESTING_BATCH_SIZE;
+    tuning->tiles.forward = tileCandidates[PickFastest(CountTileCandidates(widest), SelectTile, RunKernelTrial, &trial)];
+    if (training_batch > 1) {
+        trial.kernel = BACKWARD_KERNEL;
+        tuning->tiles.backward = tileCandidates[PickFastest(CountTileCandidates(tallest), SelectTile, RunKernelTrial, &trial)];
+        trial.kernel = UPDATE_KERNEL;
+        tuning->tiles.update = tileCandidates[PickFastest(CountTileCandidates(widest), SelectTile, RunKernelTrial, &trial)];
+        // the backward kernel overwrote `inputs`, so the testing trials see the same inputs whatever the training batch
+        for (size_t i = 0; i < maxBatch * longest; i++) trial.inputs[i] = (double)(i % 13) / 13.0;
+    }
+
+    // testing batch size, by time per sample
+    trial.candidates = testingBatchCandidates;
+    trial.kernel = FORWARD_KERNEL;
+    trial.tile = tuning->tiles.forward;
+    tuning->testing_batch = testingBatchCandidates[PickFastest(testingBatchCount, SelectTestingBatch, RunKernelTrial, &trial)];
+
+    // threads, as 1 then powers of 2 up to the core count
+    size_t cores = GetCoreCount();
+    if (training_batch == 1 && cores > 1) {
+        if (AllocTrainingScratch(&stepScratch, net, 1, 0)) {
+            returnValue = 1;
+            goto CleanupLabel;
+        }
+        StepTrial step = { net, &stepScratch, image, 0, { 1 } };
+        size_t count = 1;
+        for (size_t threads = 2; count < MAX_CANDIDATES && step.candidates[count - 1] < cores; threads *= 2) {
+            step.candidates[count++] = threads < cores ? threads : cores;
+        }
+        tuning->threads = step.candidates[PickFastest(count, SelectThreads, RunStepTrial, &step)];
+        DestroyWorkPool(stepScratch.forward.pool);
+    }
+
+    CleanupLabel:
+
+    FreeTrainingScratch(&stepScratch);
+    free(image);
+    free(trial.outputs);
+    free(trial.inputs);
+    free(trial.biases);
+    free(trial.weights);
+    return returnValue;
+}
+
+// Writes this host's CPU model into `model`, or "unknown" if it can't be found
+static void GetCpuModel(char *model, size_t size) {
+    (void)snprintf(model, size, "unknown");
+#if defined(__linux__)
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL) return;
+    char line[256];
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        // x86 has "model name", and some ARM kernels only "Hardware" or "CPU part"
+        if (strncmp(line, "model name", 10) != 0 && strncmp(line, "Hardware", 8) != 0 && strncmp(line, "CPU part", 8) != 0) continue;
+        char *value = strchr(line, ':');
+        if (value == NULL) continue;
+        value += strspn(value + 1, " \t") + 1;
+        value[strcspn(value, "\r\n")] = '\0';
+        (void)snprintf(model, size, "%s", value);
+        if (strncmp(line, "model name", 10) == 0) break;
+    }
+    fclose(cpuinfo);
+#elif defined(__APPLE__)
+    size_t length = size;
+    if (sysctlbyname("machdep.cpu.brand_string", model, &length, NULL, 0) != 0) (void)snprintf(model, size, "unknown");
+#endif
+    // tabs separate the fields of the cache
+    for (char *c = model; *c != '\0'; c++) {
+        if (*c == '\t') *c = ' ';
+    }
+}
+
+// Writes the cache key for `net` on this host into `key`, ending with a tab
+// Returns 0 on success, 1 if it doesn't fit
+static int GetTuningKey(const Network *net, size_t training_batch, char *key, size_t size) {
+    char model[256];
+    GetCpuModel(model, sizeof(model));
+    int length = snprintf(key, size, "%s\t%zu\t", model, GetCoreCount());
+    if (net->conv_count > 0) {
+        length += snprintf(key + length, size - (size_t)length, "%zux%zu", net->conv_layers[0].in_height, net->conv_layers[0].in_width);
+    } else {
+        length += snprintf(key + length, size - (size_t)length, "%zu", net->input_size);
+    }
+    for (size_t i = 0; i < net->conv_count && (size_t)length < size; i++) {
+        const ConvLayer *layer = &net->conv_layers[i];
+        if (layer->type == CONV_LAYER) {
+            length += snprintf(key + length, size - (size_t)length, ",conv %zu %zu %zu", layer->filters, layer->kernel, layer->stride);
+        } else {
+            length += snprintf(key + length, size - (size_t)length, ",%s %zu %zu", layer->type == MAX_POOL_LAYER ? "maxpool" : "avgpool", layer->kernel, layer->stride);
+        }
+    }
+    for (size_t i = 0; i < net->layers_count && (size_t)length < size; i++) {
+        length += snprintf(key + length, size - (size_t)length, ",%zu", net->layer_lengths[i]);
+    }
+    if ((size_t)length < size) length += snprintf(key + length, size - (size_t)length, "\t%zu\t", training_batch);
+    return (size_t)length >= size;
+}
+
+// Returns 0 on success, 1 if the cache file `filename` has no entry for `net` and `training_batch` on this host (or can't be read)
+int LoadTuning(const char *filename, const Network *net, size_t training_batch, Tuning *tuning) {
+    char key[TUNING_KEY_LENGTH];
+    if (GetTuningKey(net, training_batch, key, sizeof(key))) return 1;
+    FILE *cache = fopen(filename, "r");
+    if (cache == NULL) return 1;
+    size_t keyLength = strlen(key);
+    bool found = false;
+    char line[TUNING_KEY_LENGTH + 128];
+    while (fgets(line, sizeof(line), cache) != NULL) {
+        Tuning entry;
+        if (strncmp(line, key, keyLength) != 0) continue;
+        if (sscanf(line + keyLength, "%zu %zu %zu %zu %zu", &entry.tiles.forward, &entry.tiles.backward, &entry.tiles.update, &entry.testing_batch, &entry.threads) != 5) continue;
+        if (entry.testing_batch == 0 || entry.threads == 0) continue;
+        *tuning = entry; // later entries replace earlier ones
+        found = true;
+    }
+    fclose(cache);
+    return !found;
+}
+
+// Returns 0 on success, 1 on failure
+// Adds `tuning` to the cache file `filename` (creating it if needed) as the entry for `net` and `training_batch` on this host
+int SaveTuning(const char *filename, const Network *net, size_t training_batch, const Tuning *tuning) {
+    char key[TUNING_KEY_LENGTH];
+    if (GetTuningKey(net, training_batch, key, sizeof(key))) return 1;
+    FILE *cache = fopen(filename, "a");
+    if (cache == NULL) return 1;
+    int written = fprintf(cache, "%s%zu\t%zu\t%zu\t%zu\t%zu\n", key, tuning->tiles.forward, tuning->tiles.backward, tuning->tiles.update, tuning->testing_batch, tuning->threads);
+    return (fclose(cache) != 0) | (written < 0);
+}
\ No newline at end of file
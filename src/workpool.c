@@ -0,0 +1,249 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L // for `sched_yield()`
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "threadpool.h"
+#ifdef NN_USE_THREADS
+    #include <pthread.h>
+    #include <sched.h>
+    #include <stdatomic.h>
+#endif
+
+/*
+    Contains a work-stealing thread pool for splitting single operators (one layer of one sample) across cores
+
+    Unlike `ThreadPool`, which hands out chunks from one shared counter and puts idle workers to sleep, this is built for loops
+    lasting microseconds: each thread starts with its own contiguous share of the loop and takes chunks from the front of it,
+    then steals the back half of another thread's share once its own runs out; idle workers spin for a while before sleeping,
+    so a loop posted soon after the last one starts without waiting on a wakeup
+
+    Built without `NN_USE_THREADS`, every pool has a single thread and runs loops serially
+*/
+
+extern size_t GetCoreCount(void); // from `threadpool.c`
+
+#define SPIN_LIMIT 20000 // checks for a new loop before an idle worker sleeps
+#define SPINS_PER_YIELD 64 // so spinning workers don't starve the thread posting loops on an oversubscribed machine
+
+#ifdef NN_USE_THREADS
+// The indices of the current loop that one thread hasn't claimed yet
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+    char padding[64]; // keeps each queue on its own cache line
+} WorkQueue;
+#endif
+
+struct WorkPool {
+    size_t thread_count; // including the thread calling `WorkPoolFor()`
+#ifdef NN_USE_THREADS
+    pthread_t *threads;
+    WorkQueue *queues; // one per thread
+    pthread_mutex_t lock; // guards `sleepers`, for `start`
+    pthread_cond_t start; // signalled when a loop is posted or the pool is stopping, for sleeping workers
+    size_t sleepers;
+    atomic_size_t generation; // incremented for every loop posted
+    atomic_size_t remaining; // indices of the current loop not yet run
+    atomic_bool stopping;
+    // current loop; written before its indices are put in the queues, so visible to any thread that claims one
+    ParallelTask task;
+    void *context;
+    size_t grain;
+#endif
+};
+
+#ifdef NN_USE_THREADS
+typedef struct WorkerArgs {
+    WorkPool *pool;
+    size_t worker;
+} WorkerArgs;
+
+// Claims up to a chunk of indices from the front of `worker`'s queue, returning false if it's empty
+static bool TakeChunk(WorkPool *pool, size_t worker, size_t *begin, size_t *end) {
+    WorkQueue *queue = &pool->queues[worker];
+    pthread_mutex_lock(&queue->lock);
+    *begin = queue->begin;
+    *end = queue->end - queue->begin > pool->grain ? queue->begin + pool->grain : queue->end;
+    queue->begin = *end;
+    pthread_mutex_unlock(&queue->lock);
+    return *begin < *end;
+}
+
+// Runs `[begin, end)` of the current loop in chunks
+static void RunRange(WorkPool *pool, size_t worker, size_t begin, size_t end) {
+    while (begin < end) {
+        size_t chunkEnd = end - begin > pool->grain ? begin + pool->grain : end;
+        pool->task(pool->context, worker, begin, chunkEnd);
+        atomic_fetch_sub_explicit(&pool->remaining, chunkEnd - begin, memory_order_release);
+        begin = chunkEnd;
+    }
+}
+
+// Moves the back half of another thread's indices into `worker`'s queue, returning false if every other queue is empty
+//
+// NOTE: only one queue is locked at a time, so thieves can't deadlock on each other; if the next loop has been posted (refilling
+//       `worker`'s queue) between finding the current one empty and stealing from it, the stolen indices are run here instead
+static bool Steal(WorkPool *pool, size_t worker) {
+    for (size_t i = 1; i < pool->thread_count; i++) {
+        WorkQueue *victim = &pool->queues[(worker + i) % pool->thread_count];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->begin;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        // never less than a chunk, so a victim's last chunk can still be taken
+        size_t taken = left / 2 > pool->grain ? left / 2 : (left < pool->grain ? left : pool->grain);
+        size_t end = victim->end;
+        victim->end -= taken;
+        pthread_mutex_unlock(&victim->lock);
+        WorkQueue *own = &pool->queues[worker];
+        pthread_mutex_lock(&own->lock);
+        bool empty = own->begin == own->end;
+        if (empty) {
+            own->begin = end - taken;
+            own->end = end;
+        }
+        pthread_mutex_unlock(&own->lock);
+        if (!empty) RunRange(pool, worker, end - taken, end);
+        return true;
+    }
+    return false;
+}
+
+// Runs chunks of the current loop, from `worker`'s own queue and then stolen ones, until none are left to claim
+static void RunLoop(WorkPool *pool, size_t worker) {
+    size_t begin, end;
+    do {
+        while (TakeChunk(pool, worker, &begin, &end)) RunRange(pool, worker, begin, end);
+    } while (Steal(pool, worker));
+}
+
+static void *WorkerThread(void *arg) {
+    WorkerArgs args = *(WorkerArgs*)arg;
+    free(arg);
+    WorkPool *pool = args.pool;
+    size_t seen = 0;
+    while (true) {
+        // spin briefly, as the next loop usually follows within microseconds
+        size_t generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+        for (size_t spins = 1; generation == seen && spins < SPIN_LIMIT; spins++) {
+            if (atomic_load_explicit(&pool->stopping, memory_order_acquire)) return NULL;
+            if (spins % SPINS_PER_YIELD == 0) (void)sched_yield();
+            generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+        }
+        if (generation == seen) {
+            pthread_mutex_lock(&pool->lock);
+            pool->sleepers++;
+            while ((generation = atomic_load(&pool->generation)) == seen && !atomic_load(&pool->stopping)) pthread_cond_wait(&pool->start, &pool->lock);
+            pool->sleepers--;
+            pthread_mutex_unlock(&pool->lock);
+        }
+        if (atomic_load_explicit(&pool->stopping, memory_order_acquire)) return NULL;
+        seen = generation;
+        RunLoop(pool, args.worker);
+    }
+}
+#endif
+
+// Returns NULL on failure
+// `thread_count == 0` uses one thread per core; the calling thread counts as one of the threads
+WorkPool *CreateWorkPool(size_t thread_count) {
+    if (thread_count == 0) thread_count = GetCoreCount();
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (pool == NULL) return NULL;
+    pool->thread_count = 1;
+#ifdef NN_USE_THREADS
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    pool->queues = calloc(thread_count, sizeof(WorkQueue));
+    if (pool->threads == NULL || pool->queues == NULL) {
+        free(pool->queues);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    for (size_t i = 0; i < thread_count; i++) pthread_mutex_init(&pool->queues[i].lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->remaining, 0);
+    atomic_init(&pool->stopping, false);
+    for (; pool->thread_count < thread_count; pool->thread_count++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (args == NULL) break;
+        args->pool = pool;
+        args->worker = pool->thread_count;
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, WorkerThread, args) != 0) {
+            free(args);
+            break;
+        }
+    }
+#else
+    (void)thread_count;
+#endif
+    return pool;
+}
+
+// Safe to call with NULL
+void DestroyWorkPool(WorkPool *pool) {
+    if (pool == NULL) return;
+#ifdef NN_USE_THREADS
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stopping, true);
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 1; i < pool->thread_count; i++) (void)pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    for (size_t i = 0; i < pool->thread_count; i++) pthread_mutex_destroy(&pool->queues[i].lock);
+    free(pool->queues);
+    free(pool->threads);
+#endif
+    free(pool);
+}
+
+// Number of threads, including the calling thread; fewer than requested if some couldn't be started
+size_t WorkPoolSize(const WorkPool *pool) {
+    return pool->thread_count;
+}
+
+// Runs `task` over `[0, count)` in chunks of at most `grain` indices spread across the pool, returning once all are done
+// `pool` may be NULL; loops no longer than `grain` run serially on the calling thread
+// Not reentrant, and only one thread may post loops to a pool
+void WorkPoolFor(WorkPool *pool, size_t count, size_t grain, ParallelTask task, void *context) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+#ifdef NN_USE_THREADS
+    if (pool != NULL && pool->thread_count > 1 && count > grain) {
+        pool->task = task;
+        pool->context = context;
+        pool->grain = grain;
+        atomic_store_explicit(&pool->remaining, count, memory_order_relaxed);
+        // contiguous shares, so each thread walks its own part of the weights
+        size_t share = (count + pool->thread_count - 1) / pool->thread_count;
+        for (size_t i = 0; i < pool->thread_count; i++) {
+            WorkQueue *queue = &pool->queues[i];
+            pthread_mutex_lock(&queue->lock);
+            queue->begin = i * share < count ? i * share : count;
+            queue->end = (i + 1) * share < count ? (i + 1) * share : count;
+            pthread_mutex_unlock(&queue->lock);
+        }
+        atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+        pthread_mutex_lock(&pool->lock);
+        if (pool->sleepers > 0) pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        RunLoop(pool, 0);
+        // the last chunks may still be running on other threads
+        for (size_t spins = 1; atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0; spins++) {
+            if (spins % SPINS_PER_YIELD == 0) (void)sched_yield();
+        }
+        return;
+    }
+#else
+    (void)pool;
+#endif
+    for (size_t begin = 0; begin < count; begin += grain) task(context, 0, begin, begin + grain < count ? begin + grain : count);
+}
\ No newline at end of file